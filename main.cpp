@@ -6,50 +6,140 @@
 #include <QSlider>
 #include <QLabel>
 #include <QWidget>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QScopedPointer>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <random>
 #include "src/visualization/SolarSystemWidget.h"
 #include "src/physics/NBodySimulation.h"
 #include "src/physics/CelestialBody.h"
+#include "src/physics/EnsembleRunner.h"
+#include "src/remote/RemoteControlServer.h"
+#include "src/profiling/Profiler.h"
 
-int main(int argc, char *argv[])
+static const double AU = 1.495978707e11; // Meters
+
+// Adds `count` asteroids on near-circular orbits between 2.1 and 3.3 AU around the sun.
+// The same seed always produces the same belt, so solver comparisons are repeatable.
+static void addSyntheticBelt(NBodySimulation& simulation, const CelestialBody& sun, int count, unsigned seed)
 {
-    QApplication app(argc, argv);
+    const double G = 6.67430e-11;
+    const double pi = 3.14159265358979323846;
 
-    // --- Main Window and Layouts ---
-    QMainWindow mainWindow;
-    QWidget *centralWidget = new QWidget;
-    QVBoxLayout *mainLayout = new QVBoxLayout(centralWidget);
-    QHBoxLayout *controlsLayout = new QHBoxLayout();
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
 
-    // --- Simulation and Visualization ---
-    NBodySimulation simulation;
-    SolarSystemWidget *solarSystemWidget = new SolarSystemWidget(&simulation);
+    for (int i = 0; i < count; ++i) {
+        double radius = (2.1 + 1.2 * unit(rng)) * AU;
+        double anomaly = 2.0 * pi * unit(rng);
+        double inclination = (unit(rng) - 0.5) * 0.35; // About +/-10 degrees
+        double node = 2.0 * pi * unit(rng);
+        double speed = std::sqrt(G * sun.getMass() / radius);
 
-    // --- UI Controls ---
-    QPushButton *playButton = new QPushButton("Play");
-    QPushButton *pauseButton = new QPushButton("Pause");
-    QLabel *timeScaleLabel = new QLabel("Time Scale:");
-    QSlider *timeScaleSlider = new QSlider(Qt::Horizontal);
-    timeScaleSlider->setRange(0, 100);
-    timeScaleSlider->setValue(30); // Start at a moderate speed instead of 50
-    timeScaleSlider->setToolTip("Adjust simulation speed (0.1x to 100,000x)");
+        // In-plane circular state, tilted about x by the inclination, then about z by the node
+        double px = radius * std::cos(anomaly), py = radius * std::sin(anomaly);
+        double vx = -speed * std::sin(anomaly), vy = speed * std::cos(anomaly);
+        QVector3D position(px, py * std::cos(inclination), py * std::sin(inclination));
+        QVector3D velocity(vx, vy * std::cos(inclination), vy * std::sin(inclination));
+        auto rotateNode = [node](const QVector3D& v) {
+            return QVector3D(v.x() * std::cos(node) - v.y() * std::sin(node),
+                             v.x() * std::sin(node) + v.y() * std::cos(node),
+                             v.z());
+        };
 
-    // --- Add Controls to Layout ---
-    controlsLayout->addWidget(playButton);
-    controlsLayout->addWidget(pauseButton);
-    controlsLayout->addSpacing(20);
-    controlsLayout->addWidget(timeScaleLabel);
-    controlsLayout->addWidget(timeScaleSlider);
+        CelestialBody asteroid(
+            1e15 + 1e18 * unit(rng),                        // Mass in kg
+            sun.getPosition() + rotateNode(position),
+            sun.getVelocity() + rotateNode(velocity),
+            (5.0 + 45.0 * unit(rng)) * 1e3,                 // Radius in meters
+            QString("Belt %1").arg(i + 1),
+            QColor(120, 120, 120)
+        );
+        asteroid.setTrailEnabled(false); // Thousands of trails would only bury the planets' trails
+        simulation.addBody(asteroid);
+    }
+}
 
-    // --- Assemble Main Layout ---
-    mainLayout->addWidget(solarSystemWidget);
-    mainLayout->addLayout(controlsLayout);
+// Ensemble runs are headless, so the application type is chosen before Qt parses arguments
+static bool isEnsembleRun(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        QString argument(argv[i]);
+        if (argument == "--ensemble" || argument.startsWith("--ensemble=")) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    // --- Connect Signals and Slots ---
-    QObject::connect(playButton, &QPushButton::clicked, &simulation, &NBodySimulation::play);
-    QObject::connect(pauseButton, &QPushButton::clicked, &simulation, &NBodySimulation::pause);
-    QObject::connect(timeScaleSlider, &QSlider::valueChanged, &simulation, &NBodySimulation::setTimeScale);
+// Integrates perturbed copies of the catalogue and streams one CSV row per member per report
+static int runEnsemble(const std::vector<CelestialBody>& bodies, const EnsembleRunner::Config& config)
+{
+    EnsembleRunner ensemble(bodies, config);
+    const CelestialBody& tracked = bodies[config.trackedBody];
+
+    QTextStream out(stdout);
+    out << "time_s,member,body,x_m,y_m,z_m,vx_m_s,vy_m_s,vz_m_s,nominal_distance_m,energy_error\n";
+    ensemble.run([&](const EnsembleRunner::MemberSummary& summary) {
+        out << QString::number(summary.time, 'f', 0) << ',' << summary.member << ',' << tracked.getName();
+        for (double value : summary.position) out << ',' << QString::number(value, 'e', 10);
+        for (double value : summary.velocity) out << ',' << QString::number(value, 'e', 10);
+        out << ',' << QString::number(summary.nominalDistance, 'e', 6)
+            << ',' << QString::number(summary.energyError, 'e', 3) << '\n';
+    });
+    out.flush();
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QScopedPointer<QCoreApplication> app(isEnsembleRun(argc, argv)
+                                             ? new QCoreApplication(argc, argv)
+                                             : new QApplication(argc, argv));
+
+    // --- Command Line ---
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Solar System Simulator");
+    parser.addHelpOption();
+    QCommandLineOption solverOption("solver", "Gravity solver: direct (default) or fmm.", "solver", "direct");
+    QCommandLineOption fmmOrderOption("fmm-order", "FMM expansion order, 1-16 (default 6).", "order", "6");
+    QCommandLineOption beltOption("belt", "Add <count> synthetic main-belt asteroids.", "count", "0");
+    QCommandLineOption validateOption("validate-forces", "Log the FMM force error against direct summation at startup.");
+    QCommandLineOption keplerBeyondOption("kepler-beyond", "Propagate bodies farther than <au> AU on Kepler orbits instead of integrating them.", "au");
+    QCommandLineOption keplerRefreshOption("kepler-refresh", "Days between Kepler orbit perturbation updates (default 100).", "days", "100");
+    QCommandLineOption keplerMaxMassOption("kepler-max-mass", "Heaviest body --kepler-beyond may flag, in kg (default 1e23, lighter than any planet).", "kg", "1e23");
+    QCommandLineOption genericKernelsOption("generic-kernels", "Use the generic direct solver even for small catalogues.");
+    QCommandLineOption ensembleOption("ensemble", "Run <members> perturbed copies headless and print CSV summaries.", "members");
+    QCommandLineOption seedOption("seed", "Ensemble perturbation seed (default 1).", "seed", "1");
+    QCommandLineOption ensembleDaysOption("ensemble-days", "Simulated days per ensemble run (default 365).", "days", "365");
+    QCommandLineOption reportDaysOption("report-days", "Days between ensemble summaries (default 30).", "days", "30");
+    QCommandLineOption trackOption("track", "Body reported by the ensemble (default Terra).", "name", "Terra");
+    QCommandLineOption noProfilerOption("no-profiler", "Do not record profiler zones (the P overlay and T trace stay empty).");
+    QCommandLineOption remoteOption("remote", "Accept remote control and state subscriptions on local socket <name>.", "name");
+    parser.addOption(solverOption);
+    parser.addOption(fmmOrderOption);
+    parser.addOption(beltOption);
+    parser.addOption(validateOption);
+    parser.addOption(keplerBeyondOption);
+    parser.addOption(keplerRefreshOption);
+    parser.addOption(keplerMaxMassOption);
+    parser.addOption(genericKernelsOption);
+    parser.addOption(ensembleOption);
+    parser.addOption(seedOption);
+    parser.addOption(ensembleDaysOption);
+    parser.addOption(reportDaysOption);
+    parser.addOption(trackOption);
+    parser.addOption(noProfilerOption);
+    parser.addOption(remoteOption);
+    parser.process(*app);
+    Profiler::setEnabled(!parser.isSet(noProfilerOption));
+
+    // --- Simulation ---
+    NBodySimulation simulation;
 
-    
     // Data from JPL Horizons for A.D. 2025-Aug-17 00:00:00.0000 TDB
     // All position and velocity units are converted from km to meters (* 1000)
 
@@ -243,6 +333,146 @@ int main(int argc, char *argv[])
     simulation.addBody(haumea);
     simulation.addBody(interamnia);
 
+    int beltCount = parser.value(beltOption).toInt();
+    if (beltCount > 0) {
+        addSyntheticBelt(simulation, sun, beltCount, 42);
+    }
+
+    // --- Gravity Solver ---
+    const QString solver = parser.value(solverOption);
+    if (solver != "direct" && solver != "fmm") {
+        qCritical() << "--solver must be direct or fmm, got" << solver;
+        return 1;
+    }
+    bool orderOk = false;
+    const int fmmOrder = parser.value(fmmOrderOption).toInt(&orderOk);
+    if (!orderOk || fmmOrder < 1 || fmmOrder > FmmGravity::MAX_ORDER) {
+        qCritical() << "--fmm-order must be a whole number from 1 to" << FmmGravity::MAX_ORDER
+                    << "but got" << parser.value(fmmOrderOption);
+        return 1;
+    }
+    simulation.getFmmGravity().setOrder(fmmOrder);
+    if (solver == "fmm") {
+        simulation.setForceSolver(NBodySimulation::ForceSolver::FastMultipole);
+    }
+    simulation.setFixedSizeKernelsEnabled(!parser.isSet(genericKernelsOption));
+
+    // --- Hybrid Kepler Propagation ---
+    if (parser.isSet(keplerBeyondOption)) {
+        // A typo would otherwise parse as 0 and flag every body, or run the kicks backwards
+        auto positiveValue = [&parser](const QCommandLineOption& option, const char* name, double& value) {
+            bool ok = false;
+            value = parser.value(option).toDouble(&ok);
+            if (!ok || !std::isfinite(value) || value <= 0.0) {
+                qCritical() << name << "must be a positive number, got" << parser.value(option);
+                return false;
+            }
+            return true;
+        };
+        double beyond, refreshDays, maximumMass;
+        if (!positiveValue(keplerBeyondOption, "--kepler-beyond", beyond) ||
+            !positiveValue(keplerRefreshOption, "--kepler-refresh", refreshDays) ||
+            !positiveValue(keplerMaxMassOption, "--kepler-max-mass", maximumMass)) {
+            return 1;
+        }
+        simulation.setKeplerRefreshInterval(refreshDays * 24.0 * 3600.0);
+        size_t flagged = simulation.setKeplerPropagationBeyond(beyond * AU, maximumMass);
+        qDebug() << "Kepler propagation for" << flagged << "bodies beyond" << beyond << "AU and under" << maximumMass << "kg";
+    }
+    if (parser.isSet(validateOption)) {
+        FmmGravity::ErrorReport report = simulation.validateFmm();
+        qDebug() << "FMM order" << simulation.getFmmGravity().getOrder()
+                 << "vs direct over" << report.sampleCount << "bodies: rms relative error"
+                 << report.rmsRelativeError << ", max" << report.maxRelativeError;
+    }
+
+    if (parser.isSet(ensembleOption)) {
+        // Durations are counted in one-hour steps; less than one step (or an absurd number) is rejected
+        auto stepsFor = [&parser](const QCommandLineOption& option, const char* name, size_t& steps) {
+            bool ok = false;
+            const double hours = parser.value(option).toDouble(&ok) * 24.0;
+            if (!ok || !(hours >= 1.0 && hours <= 1e12)) {
+                qCritical() << name << "must be between one hour (1/24 day) and 1e12 hours, got" << parser.value(option);
+                return false;
+            }
+            steps = static_cast<size_t>(hours);
+            return true;
+        };
+
+        EnsembleRunner::Config config;
+        bool membersOk = false;
+        config.memberCount = parser.value(ensembleOption).toULongLong(&membersOk);
+        if (!membersOk || config.memberCount == 0) {
+            qCritical() << "--ensemble needs a positive member count, got" << parser.value(ensembleOption);
+            return 1;
+        }
+        config.seed = parser.value(seedOption).toULongLong();
+        config.timeStep = 3600.0; // Same base step as the interactive simulation
+        if (!stepsFor(ensembleDaysOption, "--ensemble-days", config.stepCount) ||
+            !stepsFor(reportDaysOption, "--report-days", config.reportInterval)) {
+            return 1;
+        }
+        config.fixedSizeKernels = simulation.getFixedSizeKernelsEnabled();
+        const auto& bodies = simulation.getBodies();
+        auto tracked = std::find_if(bodies.begin(), bodies.end(), [&](const CelestialBody& body) {
+            return body.getName() == parser.value(trackOption);
+        });
+        if (tracked == bodies.end()) {
+            qCritical() << "--track: no body named" << parser.value(trackOption);
+            return 1;
+        }
+        config.trackedBody = static_cast<size_t>(tracked - bodies.begin());
+        return runEnsemble(bodies, config);
+    }
+
+    // --- Main Window and Layouts ---
+    QMainWindow mainWindow;
+    QWidget *centralWidget = new QWidget;
+    QVBoxLayout *mainLayout = new QVBoxLayout(centralWidget);
+    QHBoxLayout *controlsLayout = new QHBoxLayout();
+
+    // --- Visualization ---
+    SolarSystemWidget *solarSystemWidget = new SolarSystemWidget(&simulation);
+
+    // --- UI Controls ---
+    QPushButton *playButton = new QPushButton("Play");
+    QPushButton *pauseButton = new QPushButton("Pause");
+    QLabel *timeScaleLabel = new QLabel("Time Scale:");
+    QSlider *timeScaleSlider = new QSlider(Qt::Horizontal);
+    timeScaleSlider->setRange(0, 100);
+    timeScaleSlider->setValue(30); // Start at a moderate speed instead of 50
+    timeScaleSlider->setToolTip("Adjust simulation speed (0.1x to 100,000x)");
+
+    // --- Add Controls to Layout ---
+    controlsLayout->addWidget(playButton);
+    controlsLayout->addWidget(pauseButton);
+    controlsLayout->addSpacing(20);
+    controlsLayout->addWidget(timeScaleLabel);
+    controlsLayout->addWidget(timeScaleSlider);
+
+    // --- Assemble Main Layout ---
+    mainLayout->addWidget(solarSystemWidget);
+    mainLayout->addLayout(controlsLayout);
+
+    // --- Connect Signals and Slots ---
+    QObject::connect(playButton, &QPushButton::clicked, &simulation, &NBodySimulation::play);
+    QObject::connect(pauseButton, &QPushButton::clicked, &simulation, &NBodySimulation::pause);
+    QObject::connect(timeScaleSlider, &QSlider::valueChanged, &simulation, &NBodySimulation::setTimeScale);
+
+    // --- Remote Control ---
+    // Remote commands go through the same slots as the buttons, and through the slider so it stays in sync
+    if (parser.isSet(remoteOption)) {
+        RemoteControlServer *remoteServer = new RemoteControlServer(&simulation, &mainWindow);
+        if (remoteServer->listen(parser.value(remoteOption))) {
+            qDebug() << "Remote control listening on" << remoteServer->fullServerName();
+        } else {
+            qWarning() << "Remote control could not listen on" << parser.value(remoteOption) << ":" << remoteServer->errorString();
+        }
+        QObject::connect(remoteServer, &RemoteControlServer::playRequested, &simulation, &NBodySimulation::play);
+        QObject::connect(remoteServer, &RemoteControlServer::pauseRequested, &simulation, &NBodySimulation::pause);
+        QObject::connect(remoteServer, &RemoteControlServer::timeScaleRequested, timeScaleSlider, &QSlider::setValue);
+    }
+
     // --- Show Window and Start ---
     mainWindow.setCentralWidget(centralWidget);
     mainWindow.setWindowTitle("Solar System Simulator");
@@ -252,5 +482,5 @@ int main(int argc, char *argv[])
     // Start the simulation timer
     simulation.start();
 
-    return app.exec();
+    return app->exec();
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Test client for the simulator's remote-control socket.
+Start the simulator with --remote <name>, then for example:
+
+    python3 remote_client.py bodies
+    python3 remote_client.py timescale 60
+    python3 remote_client.py subscribe --rate 10 --fields position --bodies Terra,Mars --count 20
+
+Subscriptions print one CSV row per body per frame.
+"""
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import tempfile
+
+# Wire format, see src/remote/RemoteControlServer.h
+MAGIC = 0x4D495353
+HEADER = struct.Struct("<IHHI")                # magic, type, reserved, payload length
+REPLY, BODY_LIST, STATE_FRAME = 1, 2, 3
+POSITION, VELOCITY = 1, 2
+FRAME_PREFIX = struct.Struct("<dIHHII")        # time, sequence, fields, reserved, count, total bodies
+BODY_ENTRY = struct.Struct("<Idd4BH")          # index, mass, radius, rgba, name length
+
+
+def socket_path(name):
+    """QLocalServer puts relative names in the temp directory"""
+    return name if os.path.isabs(name) else os.path.join(tempfile.gettempdir(), name)
+
+
+def read_exactly(sock, size):
+    data = bytearray()
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise ConnectionError("server closed the connection")
+        data.extend(chunk)
+    return bytes(data)
+
+
+def read_message(sock):
+    magic, message_type, _, length = HEADER.unpack(read_exactly(sock, HEADER.size))
+    if magic != MAGIC:
+        raise ValueError(f"bad magic 0x{magic:08x}")
+    return message_type, read_exactly(sock, length)
+
+
+def decode_body_list(payload):
+    """Returns [(index, name, mass_kg, radius_m, (r, g, b, a))]"""
+    (count,) = struct.unpack_from("<I", payload, 0)
+    offset = 4
+    bodies = []
+    for _ in range(count):
+        index, mass, radius, r, g, b, a, name_length = BODY_ENTRY.unpack_from(payload, offset)
+        offset += BODY_ENTRY.size
+        name = payload[offset:offset + name_length].decode("utf-8")
+        offset += name_length
+        bodies.append((index, name, mass, radius, (r, g, b, a)))
+    return bodies
+
+
+def decode_state_frame(payload):
+    """Returns (time_s, sequence, total_bodies, [(index, position or None, velocity or None)])"""
+    time, sequence, fields, _, count, total = FRAME_PREFIX.unpack_from(payload, 0)
+    vector_count = bool(fields & POSITION) + bool(fields & VELOCITY)
+    expected = FRAME_PREFIX.size + 4 * count + 12 * count * vector_count
+    if len(payload) != expected:
+        raise ValueError(f"state frame is {len(payload)} bytes, expected {expected}")
+    offset = FRAME_PREFIX.size
+    indices = struct.unpack_from(f"<{count}I", payload, offset)
+    offset += 4 * count
+
+    def vectors(present):
+        nonlocal offset
+        if not present:
+            return [None] * count
+        values = list(struct.iter_unpack("<3f", payload[offset:offset + 12 * count]))
+        offset += 12 * count
+        return values
+
+    positions = vectors(fields & POSITION)
+    velocities = vectors(fields & VELOCITY)
+    return time, sequence, total, list(zip(indices, positions, velocities))
+
+
+def send_command(sock, line):
+    sock.sendall((line + "\n").encode("utf-8"))
+
+
+def expect_reply(sock):
+    """Reads up to the next reply, skipping any state frames still in flight"""
+    while True:
+        message_type, payload = read_message(sock)
+        if message_type == REPLY:
+            text = payload.decode("utf-8")
+            if text.startswith("error"):
+                raise RuntimeError(text)
+            return text
+
+
+def fetch_bodies(sock):
+    send_command(sock, "bodies")
+    while True:
+        message_type, payload = read_message(sock)
+        if message_type == BODY_LIST:
+            return decode_body_list(payload)
+
+
+def stream(sock, args):
+    names = {index: name for index, name, *_ in fetch_bodies(sock)}
+    options = [f"rate={args.rate}", f"fields={args.fields}"]
+    if args.bodies:
+        options.append(f"bodies={args.bodies}")  # Must be last: names may contain spaces
+    send_command(sock, "subscribe " + " ".join(options))
+    expect_reply(sock)
+
+    print("time_s,sequence,body,x_m,y_m,z_m,vx_m_s,vy_m_s,vz_m_s")
+    frames = 0
+    while args.count == 0 or frames < args.count:
+        message_type, payload = read_message(sock)
+        if message_type != STATE_FRAME:
+            continue
+        time, sequence, _, states = decode_state_frame(payload)
+        for index, position, velocity in states:
+            values = list(position or ("",) * 3) + list(velocity or ("",) * 3)
+            print(f"{time:.0f},{sequence},{names.get(index, index)}," + ",".join(str(v) for v in values))
+        sys.stdout.flush()
+        frames += 1
+
+    send_command(sock, "unsubscribe")
+    print(expect_reply(sock), file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Remote control and state streaming test client")
+    parser.add_argument("--socket", default="ss_sim", help="Name passed to --remote (default ss_sim)")
+    commands = parser.add_subparsers(dest="command", required=True)
+    commands.add_parser("play")
+    commands.add_parser("pause")
+    timescale = commands.add_parser("timescale")
+    timescale.add_argument("value", type=int, help="Slider position, 0-100")
+    commands.add_parser("bodies")
+    subscribe = commands.add_parser("subscribe")
+    subscribe.add_argument("--rate", type=float, default=0, help="Maximum frames per second (0 = every step)")
+    subscribe.add_argument("--fields", choices=["position", "velocity", "state"], default="state")
+    subscribe.add_argument("--bodies", default="", help="Comma-separated names or indices (default all)")
+    subscribe.add_argument("--count", type=int, default=0, help="Stop after this many frames (0 = never)")
+    args = parser.parse_args()
+
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(socket_path(args.socket))
+        if args.command == "bodies":
+            for index, name, mass, radius, color in fetch_bodies(sock):
+                print(f"{index:4d}  {name:<16} mass {mass:.4e} kg  radius {radius:.4e} m  rgba {color}")
+        elif args.command == "subscribe":
+            stream(sock, args)
+        else:
+            line = args.command if args.command != "timescale" else f"timescale {args.value}"
+            send_command(sock, line)
+            print(expect_reply(sock))
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass
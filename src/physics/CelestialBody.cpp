@@ -15,29 +15,20 @@ CelestialBody::CelestialBody(
     m_name(name),
     m_color(color)
 {
-    // Initialize both history types with the starting position
-    addPositionToHistory(position);
+    m_trail.reset(0.0, position, velocity);
 }
 
-void CelestialBody::addPositionToHistory(const QVector3D& position)
+void CelestialBody::setTrailEnabled(bool enabled)
 {
-    // Add to the short-term fading trail
-    m_positionHistory.push_back(position);
-    if (m_positionHistory.size() > MAX_HISTORY_SIZE) {
-        m_positionHistory.pop_front();
-    }
-
-    // Add to the long-term full orbit trace
-    m_fullOrbitTrace.push_back(position);
+    m_trail.setEnabled(enabled);
 }
 
-const std::deque<QVector3D>& CelestialBody::getPositionHistory() const
+void CelestialBody::resetTrail(double time)
 {
-    return m_positionHistory;
+    m_trail.reset(time, m_position, m_velocity);
 }
 
-// Getter for the full orbit trace
-const std::vector<QVector3D>& CelestialBody::getFullOrbitTrace() const
+void CelestialBody::sampleTrail(double time)
 {
-    return m_fullOrbitTrace;
+    m_trail.feed(time, m_position, m_velocity);
 }
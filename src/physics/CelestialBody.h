@@ -4,8 +4,8 @@
 #include <QVector3D>
 #include <QString>
 #include <QColor>
-#include <deque>
 #include <vector> // Include the vector header
+#include "TrailSampler.h"
 
 class CelestialBody
 {
@@ -29,12 +29,13 @@ public:
     void setPosition(const QVector3D& position) { m_position = position; }
     void setVelocity(const QVector3D& velocity) { m_velocity = velocity; }
 
-    // Methods for orbital trails
-    void addPositionToHistory(const QVector3D& position);
-    const std::deque<QVector3D>& getPositionHistory() const;
-    
-    // Method to get the full orbital path
-    const std::vector<QVector3D>& getFullOrbitTrace() const;
+    // Methods for orbital trails. The trail is sampled from the current state at simulated
+    // time `time`; call sampleTrail() after every integrator substep. Bulk bodies that are
+    // not worth a trail can switch it off to save its memory and upkeep.
+    void setTrailEnabled(bool enabled);
+    void resetTrail(double time);
+    void sampleTrail(double time);
+    const TrailSampler& getTrail() const { return m_trail; }
 
 private:
     double m_mass;
@@ -45,11 +46,7 @@ private:
     QColor m_color;
 
     // For the short, fading trail
-    std::deque<QVector3D> m_positionHistory;
-    static const size_t MAX_HISTORY_SIZE = 2000;
-
-    // For the full, persistent orbital trace
-    std::vector<QVector3D> m_fullOrbitTrace;
+    TrailSampler m_trail;
 };
 
 #endif // CELESTIALBODY_H
@@ -0,0 +1,265 @@
+#include "EnsembleRunner.h"
+#include "FixedNBodyEngine.h"
+#include "ThreadPool.h"
+#include "../profiling/Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+const double G = 6.67430e-11;
+const double MIN_SEPARATION_SQ = 1e6; // Same 1 km singularity guard as NBodySimulation
+// Lanes per parallel chunk (a multiple of any SIMD width), matching the fixed-size engine
+const size_t MEMBER_BLOCK = FixedNBodyEngine::ENSEMBLE_LANES;
+
+// SplitMix64 finaliser: decorrelates the per-member seeds derived from one run seed
+std::uint64_t mixSeed(std::uint64_t seed, std::uint64_t member)
+{
+    std::uint64_t z = seed + 0x9E3779B97F4A7C15ull * (member + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Pull between bodies i and j across lanes [begin, end). Every array is a different
+// body/component row, hence __restrict, and the loop has no branches, so it vectorises.
+void accumulatePair(const double* __restrict xi, const double* __restrict yi, const double* __restrict zi,
+                    const double* __restrict xj, const double* __restrict yj, const double* __restrict zj,
+                    double* __restrict axi, double* __restrict ayi, double* __restrict azi,
+                    double* __restrict axj, double* __restrict ayj, double* __restrict azj,
+                    double gmi, double gmj, size_t begin, size_t end)
+{
+    for (size_t k = begin; k < end; ++k) {
+        const double dx = xj[k] - xi[k];
+        const double dy = yj[k] - yi[k];
+        const double dz = zj[k] - zi[k];
+        const double rSq = dx * dx + dy * dy + dz * dz;
+        // Pairs closer than 1 km are dropped with a select rather than a branch
+        const double safeRSq = std::max(rSq, MIN_SEPARATION_SQ);
+        const double invR3 = rSq < MIN_SEPARATION_SQ ? 0.0 : 1.0 / (safeRSq * std::sqrt(safeRSq));
+        axi[k] += gmj * invR3 * dx;
+        ayi[k] += gmj * invR3 * dy;
+        azi[k] += gmj * invR3 * dz;
+        axj[k] -= gmi * invR3 * dx;
+        ayj[k] -= gmi * invR3 * dy;
+        azj[k] -= gmi * invR3 * dz;
+    }
+}
+
+} // namespace
+
+EnsembleRunner::EnsembleRunner(const std::vector<CelestialBody>& bodies, const Config& config)
+    : m_config(config),
+      m_bodyCount(bodies.size()),
+      m_memberCount(std::max<size_t>(1, config.memberCount))
+{
+    m_config.trackedBody = std::min(m_config.trackedBody, m_bodyCount ? m_bodyCount - 1 : 0);
+
+    const size_t size = m_bodyCount * m_memberCount;
+    m_mass.resize(m_bodyCount);
+    m_x.resize(size);
+    m_y.resize(size);
+    m_z.resize(size);
+    m_vx.resize(size);
+    m_vy.resize(size);
+    m_vz.resize(size);
+    m_ax.assign(size, 0.0);
+    m_ay.assign(size, 0.0);
+    m_az.assign(size, 0.0);
+
+    // Clone the catalogue into every lane
+    for (size_t b = 0; b < m_bodyCount; ++b) {
+        const CelestialBody& body = bodies[b];
+        m_mass[b] = body.getMass();
+        std::fill_n(m_x.data() + lane(b, 0), m_memberCount, body.getPosition().x());
+        std::fill_n(m_y.data() + lane(b, 0), m_memberCount, body.getPosition().y());
+        std::fill_n(m_z.data() + lane(b, 0), m_memberCount, body.getPosition().z());
+        std::fill_n(m_vx.data() + lane(b, 0), m_memberCount, body.getVelocity().x());
+        std::fill_n(m_vy.data() + lane(b, 0), m_memberCount, body.getVelocity().y());
+        std::fill_n(m_vz.data() + lane(b, 0), m_memberCount, body.getVelocity().z());
+    }
+
+    perturbMembers();
+}
+
+void EnsembleRunner::perturbMembers()
+{
+    // Member 0 stays nominal
+    for (size_t member = 1; member < m_memberCount; ++member) {
+        std::mt19937_64 rng(mixSeed(m_config.seed, member));
+        std::normal_distribution<double> positionNoise(0.0, m_config.positionSigma);
+        std::normal_distribution<double> velocityNoise(0.0, m_config.velocitySigma);
+        for (size_t b = 0; b < m_bodyCount; ++b) {
+            const size_t i = lane(b, member);
+            m_x[i] += positionNoise(rng);
+            m_y[i] += positionNoise(rng);
+            m_z[i] += positionNoise(rng);
+            m_vx[i] += velocityNoise(rng);
+            m_vy[i] += velocityNoise(rng);
+            m_vz[i] += velocityNoise(rng);
+        }
+    }
+}
+
+void EnsembleRunner::computeAccelerations(size_t memberBegin, size_t memberEnd)
+{
+    for (size_t b = 0; b < m_bodyCount; ++b) {
+        std::fill(m_ax.data() + lane(b, memberBegin), m_ax.data() + lane(b, memberEnd), 0.0);
+        std::fill(m_ay.data() + lane(b, memberBegin), m_ay.data() + lane(b, memberEnd), 0.0);
+        std::fill(m_az.data() + lane(b, memberBegin), m_az.data() + lane(b, memberEnd), 0.0);
+    }
+
+    // Each pair once (Newton's third law)
+    for (size_t i = 0; i < m_bodyCount; ++i) {
+        for (size_t j = i + 1; j < m_bodyCount; ++j) {
+            accumulatePair(m_x.data() + lane(i, 0), m_y.data() + lane(i, 0), m_z.data() + lane(i, 0),
+                           m_x.data() + lane(j, 0), m_y.data() + lane(j, 0), m_z.data() + lane(j, 0),
+                           m_ax.data() + lane(i, 0), m_ay.data() + lane(i, 0), m_az.data() + lane(i, 0),
+                           m_ax.data() + lane(j, 0), m_ay.data() + lane(j, 0), m_az.data() + lane(j, 0),
+                           G * m_mass[i], G * m_mass[j], memberBegin, memberEnd);
+        }
+    }
+}
+
+void EnsembleRunner::advance(size_t memberBegin, size_t memberEnd, size_t steps)
+{
+    // The fixed-size engine always integrates a whole block of lanes. A partial last block
+    // that would leave more than a quarter of them as padding is cheaper on the generic loops.
+    const bool mostlyFull = 4 * (memberEnd - memberBegin) >= 3 * MEMBER_BLOCK;
+    if (m_config.fixedSizeKernels && m_bodyCount <= FixedNBodyEngine::MAX_BODIES && mostlyFull) {
+        advanceFixed(memberBegin, memberEnd, steps);
+        return;
+    }
+
+    const double dt = m_config.timeStep;
+    const double halfDt = 0.5 * dt;
+
+    computeAccelerations(memberBegin, memberEnd);
+    for (size_t step = 0; step < steps; ++step) {
+        // Velocity Verlet, with a(t + dt) of one step reused as a(t) of the next
+        for (size_t b = 0; b < m_bodyCount; ++b) {
+            for (size_t k = lane(b, memberBegin); k < lane(b, memberEnd); ++k) {
+                m_vx[k] += halfDt * m_ax[k];
+                m_vy[k] += halfDt * m_ay[k];
+                m_vz[k] += halfDt * m_az[k];
+                m_x[k] += dt * m_vx[k];
+                m_y[k] += dt * m_vy[k];
+                m_z[k] += dt * m_vz[k];
+            }
+        }
+
+        computeAccelerations(memberBegin, memberEnd);
+
+        for (size_t b = 0; b < m_bodyCount; ++b) {
+            for (size_t k = lane(b, memberBegin); k < lane(b, memberEnd); ++k) {
+                m_vx[k] += halfDt * m_ax[k];
+                m_vy[k] += halfDt * m_ay[k];
+                m_vz[k] += halfDt * m_az[k];
+            }
+        }
+    }
+}
+
+void EnsembleRunner::advanceFixed(size_t memberBegin, size_t memberEnd, size_t steps)
+{
+    const auto engine = FixedNBodyEngine::create(m_bodyCount, MEMBER_BLOCK);
+    const size_t count = memberEnd - memberBegin;
+    std::vector<double>* const rows[FixedNBodyEngine::ComponentCount] = { &m_x, &m_y, &m_z, &m_vx, &m_vy, &m_vz };
+
+    for (size_t b = 0; b < m_bodyCount; ++b) {
+        engine->setGravitationalParameter(b, G * m_mass[b]);
+        for (int c = 0; c < FixedNBodyEngine::ComponentCount; ++c) {
+            const double* source = rows[c]->data() + lane(b, memberBegin);
+            double* lanes = engine->lanes(static_cast<FixedNBodyEngine::Component>(c), b);
+            std::copy_n(source, count, lanes);
+            // A partial last block pads its spare lanes with copies of its first member
+            std::fill(lanes + count, lanes + MEMBER_BLOCK, source[0]);
+        }
+    }
+
+    engine->advance(m_config.timeStep, steps);
+
+    for (size_t b = 0; b < m_bodyCount; ++b) {
+        for (int c = 0; c < FixedNBodyEngine::ComponentCount; ++c) {
+            std::copy_n(engine->lanes(static_cast<FixedNBodyEngine::Component>(c), b), count,
+                        rows[c]->data() + lane(b, memberBegin));
+        }
+    }
+}
+
+void EnsembleRunner::computeEnergies(std::vector<double>& energies) const
+{
+    energies.assign(m_memberCount, 0.0);
+    ThreadPool::instance().parallelFor(m_memberCount, MEMBER_BLOCK, [&](size_t begin, size_t end) {
+        for (size_t member = begin; member < end; ++member) {
+            double energy = 0.0;
+            for (size_t i = 0; i < m_bodyCount; ++i) {
+                const size_t a = lane(i, member);
+                energy += 0.5 * m_mass[i] * (m_vx[a] * m_vx[a] + m_vy[a] * m_vy[a] + m_vz[a] * m_vz[a]);
+                for (size_t j = i + 1; j < m_bodyCount; ++j) {
+                    const size_t c = lane(j, member);
+                    const double dx = m_x[c] - m_x[a];
+                    const double dy = m_y[c] - m_y[a];
+                    const double dz = m_z[c] - m_z[a];
+                    const double rSq = dx * dx + dy * dy + dz * dz;
+                    if (rSq < MIN_SEPARATION_SQ) continue;
+                    energy -= G * m_mass[i] * m_mass[j] / std::sqrt(rSq);
+                }
+            }
+            energies[member] = energy;
+        }
+    });
+}
+
+void EnsembleRunner::emitSummaries(double time, const std::function<void(const MemberSummary&)>& report) const
+{
+    std::vector<double> energies;
+    computeEnergies(energies);
+
+    const size_t body = m_config.trackedBody;
+    const size_t nominal = lane(body, 0);
+    for (size_t member = 0; member < m_memberCount; ++member) {
+        const size_t i = lane(body, member);
+        MemberSummary summary;
+        summary.member = member;
+        summary.time = time;
+        summary.position[0] = m_x[i];
+        summary.position[1] = m_y[i];
+        summary.position[2] = m_z[i];
+        summary.velocity[0] = m_vx[i];
+        summary.velocity[1] = m_vy[i];
+        summary.velocity[2] = m_vz[i];
+        const double dx = m_x[i] - m_x[nominal];
+        const double dy = m_y[i] - m_y[nominal];
+        const double dz = m_z[i] - m_z[nominal];
+        summary.nominalDistance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        const double initial = m_initialEnergy[member];
+        summary.energyError = initial != 0.0 ? (energies[member] - initial) / std::fabs(initial) : 0.0;
+        report(summary);
+    }
+}
+
+void EnsembleRunner::run(const std::function<void(const MemberSummary&)>& report)
+{
+    if (m_bodyCount == 0) {
+        return;
+    }
+
+    computeEnergies(m_initialEnergy);
+
+    const size_t interval = m_config.reportInterval ? m_config.reportInterval : m_config.stepCount;
+    size_t stepsDone = 0;
+    while (stepsDone < m_config.stepCount) {
+        const size_t segment = std::min(interval, m_config.stepCount - stepsDone);
+        {
+            PROFILE_SCOPE("EnsembleRunner::advance");
+            // Members never interact, so each block of lanes runs the whole segment independently
+            ThreadPool::instance().parallelFor(m_memberCount, MEMBER_BLOCK, [this, segment](size_t begin, size_t end) {
+                advance(begin, end, segment);
+            });
+        }
+        stepsDone += segment;
+        emitSummaries(stepsDone * m_config.timeStep, report);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef ENSEMBLERUNNER_H
+#define ENSEMBLERUNNER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "CelestialBody.h"
+
+// Monte Carlo ensemble: many perturbed copies ("members") of one body catalogue,
+// integrated in lockstep with the same velocity Verlet scheme as NBodySimulation::step().
+//
+// State is stored body-major, member-minor (index = body * memberCount + member), so the
+// member index is the SIMD lane: every inner loop runs unit-stride over members.
+// Member 0 is always the unperturbed nominal run. Member k is perturbed from its own
+// generator seeded by (seed, k), so results do not depend on the thread count.
+class EnsembleRunner
+{
+public:
+    struct Config
+    {
+        size_t memberCount = 1000;
+        std::uint64_t seed = 1;
+        double positionSigma = 1000.0; // 1-sigma per-axis position perturbation, meters
+        double velocitySigma = 0.01;   // 1-sigma per-axis velocity perturbation, m/s
+        double timeStep = 3600.0;      // Seconds per integration step
+        size_t stepCount = 24 * 365;
+        size_t reportInterval = 24 * 30; // Steps between summaries (0 = only at the end)
+        size_t trackedBody = 0;          // Body whose state is reported per member
+        bool fixedSizeKernels = true;    // Use FixedNBodyEngine when the catalogue is small enough
+    };
+
+    // Per-member snapshot streamed at every report
+    struct MemberSummary
+    {
+        size_t member;
+        double time;              // Seconds since the start of the run
+        double position[3];       // Tracked body, meters
+        double velocity[3];       // Tracked body, m/s
+        double nominalDistance;   // Tracked body's distance from member 0's, meters
+        double energyError;       // Relative drift in total energy since the start
+    };
+
+    EnsembleRunner(const std::vector<CelestialBody>& bodies, const Config& config);
+
+    // Integrates all members and calls `report` once per member at every report
+    // interval (members in ascending order), plus once at the end.
+    void run(const std::function<void(const MemberSummary&)>& report);
+
+    size_t getMemberCount() const { return m_memberCount; }
+    size_t getBodyCount() const { return m_bodyCount; }
+
+private:
+    void perturbMembers();
+    void computeAccelerations(size_t memberBegin, size_t memberEnd);
+    void advance(size_t memberBegin, size_t memberEnd, size_t steps);
+    void advanceFixed(size_t memberBegin, size_t memberEnd, size_t steps);
+    void computeEnergies(std::vector<double>& energies) const;
+    void emitSummaries(double time, const std::function<void(const MemberSummary&)>& report) const;
+
+    size_t lane(size_t body, size_t member) const { return body * m_memberCount + member; }
+
+    Config m_config;
+    size_t m_bodyCount;
+    size_t m_memberCount;
+
+    std::vector<double> m_mass; // Per body
+    std::vector<double> m_x, m_y, m_z;
+    std::vector<double> m_vx, m_vy, m_vz;
+    std::vector<double> m_ax, m_ay, m_az;
+    std::vector<double> m_initialEnergy; // Per member
+};
+
+#endif // ENSEMBLERUNNER_H
@@ -0,0 +1,173 @@
+#include "FixedNBodyEngine.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+const double MIN_SEPARATION_SQ = 1e6; // Pairs closer than 1 km are skipped
+
+// Every (i, j) with i < j, in the order of the generic nested loop
+template <size_t N>
+constexpr std::array<std::array<size_t, 2>, N * (N - 1) / 2> makePairs()
+{
+    std::array<std::array<size_t, 2>, N * (N - 1) / 2> pairs{};
+    size_t p = 0;
+    for (size_t i = 0; i < N; ++i) {
+        for (size_t j = i + 1; j < N; ++j) {
+            pairs[p][0] = i;
+            pairs[p][1] = j;
+            ++p;
+        }
+    }
+    return pairs;
+}
+
+template <size_t N, size_t L>
+class FixedNBodySystem final : public FixedNBodyEngine
+{
+public:
+    FixedNBodySystem()
+        : m_accelerationsValid(false)
+    {
+        for (auto& row : m_state) {
+            row.fill(0.0);
+        }
+        m_gm.fill(0.0);
+    }
+
+    size_t getBodyCount() const override { return N; }
+    size_t getLaneCount() const override { return L; }
+
+    double* lanes(Component component, size_t body) override
+    {
+        return m_state[component].data() + body * L;
+    }
+
+    void setGravitationalParameter(size_t body, double gm) override
+    {
+        m_gm[body] = gm;
+        m_accelerationsValid = false;
+    }
+
+    void stateChanged() override { m_accelerationsValid = false; }
+
+    void advance(double dt, size_t steps) override
+    {
+        const double halfDt = 0.5 * dt;
+        if (!m_accelerationsValid) {
+            computeAccelerations();
+        }
+
+        auto& x = m_state[PositionX];
+        auto& y = m_state[PositionY];
+        auto& z = m_state[PositionZ];
+        auto& vx = m_state[VelocityX];
+        auto& vy = m_state[VelocityY];
+        auto& vz = m_state[VelocityZ];
+
+        for (size_t step = 0; step < steps; ++step) {
+            // Velocity Verlet in kick-drift-kick form: the same update as NBodySimulation::step(),
+            // but a(t + dt) of one step is reused as a(t) of the next
+            for (size_t k = 0; k < N * L; ++k) {
+                vx[k] += halfDt * m_ax[k];
+                vy[k] += halfDt * m_ay[k];
+                vz[k] += halfDt * m_az[k];
+                x[k] += dt * vx[k];
+                y[k] += dt * vy[k];
+                z[k] += dt * vz[k];
+            }
+
+            computeAccelerations();
+
+            for (size_t k = 0; k < N * L; ++k) {
+                vx[k] += halfDt * m_ax[k];
+                vy[k] += halfDt * m_ay[k];
+                vz[k] += halfDt * m_az[k];
+            }
+        }
+        m_accelerationsValid = true;
+    }
+
+private:
+    static constexpr std::array<std::array<size_t, 2>, N * (N - 1) / 2> PAIRS = makePairs<N>();
+
+    template <size_t I, size_t J>
+    void accumulatePair()
+    {
+        const auto& x = m_state[PositionX];
+        const auto& y = m_state[PositionY];
+        const auto& z = m_state[PositionZ];
+        const double gmi = m_gm[I];
+        const double gmj = m_gm[J];
+
+        for (size_t k = 0; k < L; ++k) {
+            const double dx = x[J * L + k] - x[I * L + k];
+            const double dy = y[J * L + k] - y[I * L + k];
+            const double dz = z[J * L + k] - z[I * L + k];
+            const double rSq = dx * dx + dy * dy + dz * dz;
+            // Select rather than branch, so the lane loop stays vectorisable
+            const double safeRSq = std::max(rSq, MIN_SEPARATION_SQ);
+            const double invR3 = rSq < MIN_SEPARATION_SQ ? 0.0 : 1.0 / (safeRSq * std::sqrt(safeRSq));
+            m_ax[I * L + k] += gmj * invR3 * dx;
+            m_ay[I * L + k] += gmj * invR3 * dy;
+            m_az[I * L + k] += gmj * invR3 * dz;
+            m_ax[J * L + k] -= gmi * invR3 * dx;
+            m_ay[J * L + k] -= gmi * invR3 * dy;
+            m_az[J * L + k] -= gmi * invR3 * dz;
+        }
+    }
+
+    template <size_t... P>
+    void accumulatePairs(std::index_sequence<P...>)
+    {
+        (accumulatePair<PAIRS[P][0], PAIRS[P][1]>(), ...);
+    }
+
+    void computeAccelerations()
+    {
+        m_ax.fill(0.0);
+        m_ay.fill(0.0);
+        m_az.fill(0.0);
+        accumulatePairs(std::make_index_sequence<PAIRS.size()>());
+    }
+
+    std::array<std::array<double, N * L>, ComponentCount> m_state;
+    std::array<double, N * L> m_ax, m_ay, m_az;
+    std::array<double, N> m_gm;
+    bool m_accelerationsValid;
+};
+
+template <size_t N, size_t L>
+std::unique_ptr<FixedNBodyEngine> makeSystem()
+{
+    return std::make_unique<FixedNBodySystem<N, L>>();
+}
+
+// Jump table over body counts 1..MAX_BODIES for one lane count
+template <size_t L, size_t... I>
+std::unique_ptr<FixedNBodyEngine> makeSystem(size_t bodyCount, std::index_sequence<I...>)
+{
+    using Factory = std::unique_ptr<FixedNBodyEngine> (*)();
+    static const Factory factories[] = { &makeSystem<I + 1, L>... };
+    return factories[bodyCount - 1]();
+}
+
+} // namespace
+
+std::unique_ptr<FixedNBodyEngine> FixedNBodyEngine::create(size_t bodyCount, size_t laneCount)
+{
+    if (bodyCount == 0 || bodyCount > MAX_BODIES) {
+        return nullptr;
+    }
+
+    const auto bodyCounts = std::make_index_sequence<MAX_BODIES>();
+    if (laneCount == 1) {
+        return makeSystem<1>(bodyCount, bodyCounts);
+    }
+    if (laneCount == ENSEMBLE_LANES) {
+        return makeSystem<ENSEMBLE_LANES>(bodyCount, bodyCounts);
+    }
+    return nullptr;
+}
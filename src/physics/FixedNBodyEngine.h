@@ -0,0 +1,44 @@
+#ifndef FIXEDNBODYENGINE_H
+#define FIXEDNBODYENGINE_H
+
+#include <cstddef>
+#include <memory>
+
+// Direct-summation velocity Verlet for small catalogues whose size is known when the
+// engine is created. There is one compiled implementation for every body count up to
+// MAX_BODIES. Each stores its state in std::array and enumerates the N(N-1)/2 pairs at
+// compile time, fully unrolled, so each pair is evaluated once (Newton's third law) with
+// no runtime loop bounds.
+//
+// Like EnsembleRunner, the state is body-major and lane-minor: a lane is one independent
+// copy of the system. NBodySimulation uses a single lane. EnsembleRunner runs blocks of
+// ENSEMBLE_LANES members, whose per-pair lane loops have a constant trip count.
+class FixedNBodyEngine
+{
+public:
+    static constexpr size_t MAX_BODIES = 24;
+    static constexpr size_t ENSEMBLE_LANES = 64;
+
+    enum Component { PositionX, PositionY, PositionZ, VelocityX, VelocityY, VelocityZ, ComponentCount };
+
+    // Returns nullptr when there is no specialisation: bodyCount is 0 or above MAX_BODIES,
+    // or laneCount is neither 1 nor ENSEMBLE_LANES
+    static std::unique_ptr<FixedNBodyEngine> create(size_t bodyCount, size_t laneCount);
+
+    virtual ~FixedNBodyEngine() = default;
+
+    virtual size_t getBodyCount() const = 0;
+    virtual size_t getLaneCount() const = 0;
+
+    // The getLaneCount() contiguous values of one component of one body.
+    // Call stateChanged() after writing through it.
+    virtual double* lanes(Component component, size_t body) = 0;
+    virtual void setGravitationalParameter(size_t body, double gm) = 0; // G * mass
+    // Discards the accelerations cached from the end of the previous advance()
+    virtual void stateChanged() = 0;
+
+    // Integrates `steps` steps of dt with the 1 km singularity guard of NBodySimulation
+    virtual void advance(double dt, size_t steps) = 0;
+};
+
+#endif // FIXEDNBODYENGINE_H
@@ -0,0 +1,708 @@
+#include "FmmGravity.h"
+#include "ThreadPool.h"
+#include "../profiling/Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+// Expansion kernels follow the spherical-harmonic formulation of Greengard & Rokhlin as
+// laid out in the exaFMM Laplace kernels: multipoles use the regular solid harmonics
+// r^n Y_n^m / (n+|m|)!-style normalisation, locals the singular ones, and only the
+// m >= 0 half of each expansion is stored (the rest follows from conjugate symmetry).
+
+namespace {
+
+typedef std::complex<double> Complex;
+
+const int MAX_TREE_DEPTH = 40;     // Guards against coincident bodies splitting forever
+const size_t LEAF_GRAIN = 16;      // Cells per parallel chunk
+
+inline double oddOrEven(int n)
+{
+    return (n & 1) ? -1.0 : 1.0;
+}
+
+inline double ipow2n(int m)
+{
+    return m >= 0 ? 1.0 : oddOrEven(m);
+}
+
+inline void cartesianToSpherical(double dx, double dy, double dz, double& r, double& theta, double& phi)
+{
+    r = std::sqrt(dx * dx + dy * dy + dz * dz);
+    theta = r == 0.0 ? 0.0 : std::acos(std::max(-1.0, std::min(1.0, dz / r)));
+    phi = std::atan2(dy, dx);
+}
+
+// Regular harmonics rho^n Y_n^m (and their theta derivative) for degrees 0..P-1
+void evalMultipole(int P, double rho, double alpha, double beta, Complex* Ynm, Complex* YnmTheta)
+{
+    const double x = std::cos(alpha);
+    const double y = std::sin(alpha);
+    const double invY = y == 0.0 ? 0.0 : 1.0 / y;
+    double fact = 1;
+    double pn = 1;
+    double rhom = 1;
+    const Complex ei = std::exp(Complex(0.0, beta));
+    Complex eim = 1.0;
+    for (int m = 0; m < P; ++m) {
+        double p = pn;
+        const int npn = m * m + 2 * m;
+        const int nmn = m * m;
+        Ynm[npn] = rhom * p * eim;
+        Ynm[nmn] = std::conj(Ynm[npn]);
+        double p1 = p;
+        p = x * (2 * m + 1) * p1;
+        YnmTheta[npn] = rhom * (p - (m + 1) * x * p1) * invY * eim;
+        rhom *= rho;
+        double rhon = rhom;
+        for (int n = m + 1; n < P; ++n) {
+            const int npm = n * n + n + m;
+            const int nmm = n * n + n - m;
+            rhon /= -(n + m);
+            Ynm[npm] = rhon * p * eim;
+            Ynm[nmm] = std::conj(Ynm[npm]);
+            const double p2 = p1;
+            p1 = p;
+            p = (x * (2 * n + 1) * p1 - (n + m) * p2) / (n - m + 1);
+            YnmTheta[npm] = rhon * ((n - m + 1) * p - (n + 1) * x * p1) * invY * eim;
+            rhon *= rho;
+        }
+        rhom /= -(2 * m + 2) * (2 * m + 1);
+        pn = -pn * fact * y;
+        fact += 2;
+        eim *= ei;
+    }
+}
+
+// Singular harmonics Y_n^m / rho^(n+1) for degrees 0..P-1
+void evalLocal(int P, double rho, double alpha, double beta, Complex* Ynm)
+{
+    const double x = std::cos(alpha);
+    const double y = std::sin(alpha);
+    double fact = 1;
+    double pn = 1;
+    const double invR = -1.0 / rho;
+    double rhom = -invR;
+    const Complex ei = std::exp(Complex(0.0, beta));
+    Complex eim = 1.0;
+    for (int m = 0; m < P; ++m) {
+        double p = pn;
+        const int npn = m * m + 2 * m;
+        const int nmn = m * m;
+        Ynm[npn] = rhom * p * eim;
+        Ynm[nmn] = std::conj(Ynm[npn]);
+        double p1 = p;
+        p = x * (2 * m + 1) * p1;
+        rhom *= invR;
+        double rhon = rhom;
+        for (int n = m + 1; n < P; ++n) {
+            const int npm = n * n + n + m;
+            const int nmm = n * n + n - m;
+            Ynm[npm] = rhon * p * eim;
+            Ynm[nmm] = std::conj(Ynm[npm]);
+            const double p2 = p1;
+            p1 = p;
+            p = (x * (2 * n + 1) * p1 - (n + m) * p2) / (n - m + 1);
+            rhon *= invR * (n - m + 1);
+        }
+        pn = -pn * fact * y;
+        fact += 2;
+        eim *= ei;
+    }
+}
+
+} // namespace
+
+FmmGravity::FmmGravity(int order, int leafSize, double openingAngle)
+    : m_order(0),
+      m_leafSize(1),
+      m_theta(0.5),
+      m_minSeparation(1000.0), // Same 1 km guard as NBodySimulation's direct kernel
+      m_terms(0),
+      m_coefficientCount(0),
+      m_lengthScale(1.0)
+{
+    setOrder(order);
+    setLeafSize(leafSize);
+    setOpeningAngle(openingAngle);
+}
+
+void FmmGravity::setOrder(int order)
+{
+    m_order = std::max(1, std::min(MAX_ORDER, order));
+    m_terms = m_order + 1;
+    m_coefficientCount = static_cast<size_t>(m_terms * (m_terms + 1) / 2);
+}
+
+void FmmGravity::setLeafSize(int leafSize)
+{
+    m_leafSize = std::max(1, leafSize);
+}
+
+void FmmGravity::setOpeningAngle(double theta)
+{
+    m_theta = std::max(0.05, std::min(0.95, theta));
+}
+
+void FmmGravity::computeAccelerations(const std::vector<double>& positions,
+                                      const std::vector<double>& masses,
+                                      std::vector<double>& accelerations)
+{
+    PROFILE_FINE_SCOPE("FmmGravity::computeAccelerations");
+
+    const size_t bodyCount = masses.size();
+    accelerations.assign(3 * bodyCount, 0.0);
+    if (bodyCount == 0) {
+        return;
+    }
+
+    // Copy into tree-order arrays, scaled into a unit cube so the r^n terms of
+    // high-order expansions stay well inside double range for metre-scale inputs
+    double minCorner[3] = { positions[0], positions[1], positions[2] };
+    double maxCorner[3] = { positions[0], positions[1], positions[2] };
+    for (size_t i = 1; i < bodyCount; ++i) {
+        for (int d = 0; d < 3; ++d) {
+            minCorner[d] = std::min(minCorner[d], positions[3 * i + d]);
+            maxCorner[d] = std::max(maxCorner[d], positions[3 * i + d]);
+        }
+    }
+    double extent = 0.0;
+    for (int d = 0; d < 3; ++d) {
+        extent = std::max(extent, maxCorner[d] - minCorner[d]);
+    }
+    m_lengthScale = extent > 0.0 ? extent * (1.0 + 1e-9) : 1.0;
+    const double invScale = 1.0 / m_lengthScale;
+
+    m_x.resize(bodyCount);
+    m_y.resize(bodyCount);
+    m_z.resize(bodyCount);
+    m_mass.resize(bodyCount);
+    m_treeToInput.resize(bodyCount);
+    for (size_t i = 0; i < bodyCount; ++i) {
+        m_x[i] = (positions[3 * i + 0] - 0.5 * (minCorner[0] + maxCorner[0])) * invScale;
+        m_y[i] = (positions[3 * i + 1] - 0.5 * (minCorner[1] + maxCorner[1])) * invScale;
+        m_z[i] = (positions[3 * i + 2] - 0.5 * (minCorner[2] + maxCorner[2])) * invScale;
+        m_mass[i] = masses[i];
+        m_treeToInput[i] = i;
+    }
+
+    buildTree(bodyCount);
+    buildInteractionLists();
+
+    m_ax.assign(bodyCount, 0.0);
+    m_ay.assign(bodyCount, 0.0);
+    m_az.assign(bodyCount, 0.0);
+    m_multipoles.assign(m_cells.size() * m_coefficientCount, Complex(0.0, 0.0));
+    m_locals.assign(m_cells.size() * m_coefficientCount, Complex(0.0, 0.0));
+
+    upwardPass();
+    farFieldPass();
+    downwardPass();
+    nearFieldPass();
+
+    // Undo the unit-cube scaling: a ~ m / L^2
+    const double accelerationScale = invScale * invScale;
+    for (size_t i = 0; i < bodyCount; ++i) {
+        const size_t input = m_treeToInput[i];
+        accelerations[3 * input + 0] = m_ax[i] * accelerationScale;
+        accelerations[3 * input + 1] = m_ay[i] * accelerationScale;
+        accelerations[3 * input + 2] = m_az[i] * accelerationScale;
+    }
+}
+
+void FmmGravity::buildTree(size_t bodyCount)
+{
+    PROFILE_FINE_SCOPE("fmm.tree");
+
+    m_cells.clear();
+    m_levelBegin.clear();
+    m_leaves.clear();
+
+    Cell root;
+    root.center[0] = root.center[1] = root.center[2] = 0.0;
+    root.halfWidth = 0.5;
+    root.radius = 0.0;
+    root.bodyBegin = 0;
+    root.bodyCount = bodyCount;
+    root.childBegin = -1;
+    root.childCount = 0;
+    root.parent = -1;
+    m_cells.push_back(root);
+
+    std::vector<int> levels(1, 0);
+    std::vector<double> sx, sy, sz, smass;
+    std::vector<size_t> sindex;
+    std::vector<unsigned char> octants;
+
+    // Breadth-first, so cells end up grouped by level and siblings are contiguous
+    for (size_t c = 0; c < m_cells.size(); ++c) {
+        const Cell cell = m_cells[c];
+        if (cell.bodyCount <= static_cast<size_t>(m_leafSize) || levels[c] >= MAX_TREE_DEPTH) {
+            continue;
+        }
+
+        // Counting sort of the cell's bodies by octant
+        const size_t begin = cell.bodyBegin;
+        const size_t count = cell.bodyCount;
+        size_t octantCount[8] = { 0 };
+        octants.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            const size_t b = begin + i;
+            const unsigned char octant = (m_x[b] > cell.center[0] ? 1 : 0) |
+                                         (m_y[b] > cell.center[1] ? 2 : 0) |
+                                         (m_z[b] > cell.center[2] ? 4 : 0);
+            octants[i] = octant;
+            ++octantCount[octant];
+        }
+
+        size_t octantOffset[8];
+        size_t running = 0;
+        for (int o = 0; o < 8; ++o) {
+            octantOffset[o] = running;
+            running += octantCount[o];
+        }
+
+        sx.resize(count);
+        sy.resize(count);
+        sz.resize(count);
+        smass.resize(count);
+        sindex.resize(count);
+        size_t cursor[8];
+        std::copy(octantOffset, octantOffset + 8, cursor);
+        for (size_t i = 0; i < count; ++i) {
+            const size_t b = begin + i;
+            const size_t dst = cursor[octants[i]]++;
+            sx[dst] = m_x[b];
+            sy[dst] = m_y[b];
+            sz[dst] = m_z[b];
+            smass[dst] = m_mass[b];
+            sindex[dst] = m_treeToInput[b];
+        }
+        std::copy(sx.begin(), sx.end(), m_x.begin() + begin);
+        std::copy(sy.begin(), sy.end(), m_y.begin() + begin);
+        std::copy(sz.begin(), sz.end(), m_z.begin() + begin);
+        std::copy(smass.begin(), smass.end(), m_mass.begin() + begin);
+        std::copy(sindex.begin(), sindex.end(), m_treeToInput.begin() + begin);
+
+        const int childBegin = static_cast<int>(m_cells.size());
+        const double childHalfWidth = 0.5 * cell.halfWidth;
+        for (int o = 0; o < 8; ++o) {
+            if (octantCount[o] == 0) continue;
+            Cell child;
+            child.center[0] = cell.center[0] + ((o & 1) ? childHalfWidth : -childHalfWidth);
+            child.center[1] = cell.center[1] + ((o & 2) ? childHalfWidth : -childHalfWidth);
+            child.center[2] = cell.center[2] + ((o & 4) ? childHalfWidth : -childHalfWidth);
+            child.halfWidth = childHalfWidth;
+            child.radius = 0.0;
+            child.bodyBegin = begin + octantOffset[o];
+            child.bodyCount = octantCount[o];
+            child.childBegin = -1;
+            child.childCount = 0;
+            child.parent = static_cast<int>(c);
+            m_cells.push_back(child);
+            levels.push_back(levels[c] + 1);
+        }
+        m_cells[c].childBegin = childBegin;
+        m_cells[c].childCount = static_cast<int>(m_cells.size()) - childBegin;
+    }
+
+    for (size_t c = 0; c < m_cells.size(); ++c) {
+        if (c == 0 || levels[c] != levels[c - 1]) {
+            m_levelBegin.push_back(c);
+        }
+        if (m_cells[c].childBegin < 0) {
+            m_leaves.push_back(static_cast<int>(c));
+        }
+    }
+    m_levelBegin.push_back(m_cells.size());
+
+    // Tight radius around the (geometric) center for the acceptance criterion
+    ThreadPool::instance().parallelFor(m_cells.size(), LEAF_GRAIN, [this](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            Cell& cell = m_cells[c];
+            double radiusSq = 0.0;
+            for (size_t b = cell.bodyBegin; b < cell.bodyBegin + cell.bodyCount; ++b) {
+                const double dx = m_x[b] - cell.center[0];
+                const double dy = m_y[b] - cell.center[1];
+                const double dz = m_z[b] - cell.center[2];
+                radiusSq = std::max(radiusSq, dx * dx + dy * dy + dz * dz);
+            }
+            cell.radius = std::sqrt(radiusSq);
+        }
+    });
+}
+
+void FmmGravity::buildInteractionLists()
+{
+    PROFILE_FINE_SCOPE("fmm.traversal");
+
+    m_farList.resize(m_cells.size());
+    m_nearList.resize(m_cells.size());
+    for (size_t c = 0; c < m_cells.size(); ++c) {
+        m_farList[c].clear();
+        m_nearList[c].clear();
+    }
+
+    const Cell& root = m_cells[0];
+    if (root.childBegin < 0) {
+        traverse(0, 0);
+        return;
+    }
+
+    // traverse(root, root) always splits the target first, and the root's children
+    // write to disjoint subtrees, so they can be traversed in parallel
+    ThreadPool::instance().parallelFor(static_cast<size_t>(root.childCount), 1, [this, &root](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            traverse(root.childBegin + static_cast<int>(i), 0);
+        }
+    });
+}
+
+void FmmGravity::traverse(int targetCell, int sourceCell)
+{
+    const Cell& target = m_cells[targetCell];
+    const Cell& source = m_cells[sourceCell];
+
+    const double dx = target.center[0] - source.center[0];
+    const double dy = target.center[1] - source.center[1];
+    const double dz = target.center[2] - source.center[2];
+    const double distanceSq = dx * dx + dy * dy + dz * dz;
+    const double radiusSum = target.radius + source.radius;
+
+    if (distanceSq * m_theta * m_theta > radiusSum * radiusSum) {
+        m_farList[targetCell].push_back(sourceCell);
+        return;
+    }
+
+    const bool targetIsLeaf = target.childBegin < 0;
+    const bool sourceIsLeaf = source.childBegin < 0;
+    if (targetIsLeaf && sourceIsLeaf) {
+        m_nearList[targetCell].push_back(sourceCell);
+    } else if (targetIsLeaf || (!sourceIsLeaf && source.radius > target.radius)) {
+        for (int child = source.childBegin; child < source.childBegin + source.childCount; ++child) {
+            traverse(targetCell, child);
+        }
+    } else {
+        for (int child = target.childBegin; child < target.childBegin + target.childCount; ++child) {
+            traverse(child, sourceCell);
+        }
+    }
+}
+
+void FmmGravity::upwardPass()
+{
+    PROFILE_FINE_SCOPE("fmm.upward");
+
+    const int P = m_terms;
+
+    // P2M: leaf multipoles from their bodies
+    ThreadPool::instance().parallelFor(m_leaves.size(), LEAF_GRAIN, [this, P](size_t begin, size_t end) {
+        std::vector<Complex> Ynm(P * P), YnmTheta(P * P);
+        for (size_t l = begin; l < end; ++l) {
+            const int c = m_leaves[l];
+            const Cell& cell = m_cells[c];
+            Complex* M = multipole(c);
+            for (size_t b = cell.bodyBegin; b < cell.bodyBegin + cell.bodyCount; ++b) {
+                double rho, alpha, beta;
+                cartesianToSpherical(m_x[b] - cell.center[0], m_y[b] - cell.center[1], m_z[b] - cell.center[2],
+                                     rho, alpha, beta);
+                evalMultipole(P, rho, alpha, beta, Ynm.data(), YnmTheta.data());
+                for (int n = 0; n < P; ++n) {
+                    for (int m = 0; m <= n; ++m) {
+                        M[n * (n + 1) / 2 + m] += m_mass[b] * Ynm[n * n + n - m];
+                    }
+                }
+            }
+        }
+    });
+
+    // M2M: deepest level first, each parent gathers its children
+    for (size_t level = m_levelBegin.size() - 1; level-- > 0;) {
+        const size_t first = m_levelBegin[level];
+        const size_t count = m_levelBegin[level + 1] - first;
+        ThreadPool::instance().parallelFor(count, LEAF_GRAIN, [this, P, first](size_t begin, size_t end) {
+            std::vector<Complex> Ynm(P * P), YnmTheta(P * P);
+            for (size_t i = begin; i < end; ++i) {
+                const int c = static_cast<int>(first + i);
+                const Cell& parent = m_cells[c];
+                if (parent.childBegin < 0) continue;
+                Complex* Mi = multipole(c);
+                for (int child = parent.childBegin; child < parent.childBegin + parent.childCount; ++child) {
+                    const Cell& cell = m_cells[child];
+                    const Complex* Mj = multipole(child);
+                    double rho, alpha, beta;
+                    cartesianToSpherical(parent.center[0] - cell.center[0], parent.center[1] - cell.center[1],
+                                         parent.center[2] - cell.center[2], rho, alpha, beta);
+                    evalMultipole(P, rho, alpha, beta, Ynm.data(), YnmTheta.data());
+                    for (int j = 0; j < P; ++j) {
+                        for (int k = 0; k <= j; ++k) {
+                            Complex M = 0;
+                            for (int n = 0; n <= j; ++n) {
+                                for (int m = std::max(-n, -j + k + n); m <= std::min(k - 1, n); ++m) {
+                                    const int jnkms = (j - n) * (j - n + 1) / 2 + k - m;
+                                    M += Mj[jnkms] * Ynm[n * n + n - m] * (ipow2n(m) * oddOrEven(n));
+                                }
+                                for (int m = k; m <= std::min(n, j + k - n); ++m) {
+                                    const int jnkms = (j - n) * (j - n + 1) / 2 - k + m;
+                                    M += std::conj(Mj[jnkms]) * Ynm[n * n + n - m] * oddOrEven(k + n + m);
+                                }
+                            }
+                            Mi[j * (j + 1) / 2 + k] += M;
+                        }
+                    }
+                }
+            }
+        });
+    }
+}
+
+void FmmGravity::farFieldPass()
+{
+    PROFILE_FINE_SCOPE("fmm.m2l");
+
+    const int P = m_terms;
+    ThreadPool::instance().parallelFor(m_cells.size(), LEAF_GRAIN, [this, P](size_t begin, size_t end) {
+        std::vector<Complex> Ynm2(4 * P * P);
+        for (size_t ci = begin; ci < end; ++ci) {
+            const Cell& target = m_cells[ci];
+            Complex* L = local(static_cast<int>(ci));
+            for (int cj : m_farList[ci]) {
+                const Cell& source = m_cells[cj];
+                const Complex* M = multipole(cj);
+                double rho, alpha, beta;
+                cartesianToSpherical(target.center[0] - source.center[0], target.center[1] - source.center[1],
+                                     target.center[2] - source.center[2], rho, alpha, beta);
+                evalLocal(2 * P, rho, alpha, beta, Ynm2.data());
+
+                // Written out in real arithmetic: this loop dominates the solve, and
+                // std::complex products carry inf/NaN recovery checks
+                const double* Mre = reinterpret_cast<const double*>(M);
+                const double* Y = reinterpret_cast<const double*>(Ynm2.data());
+                for (int j = 0; j < P; ++j) {
+                    for (int k = 0; k <= j; ++k) {
+                        // Separate accumulators for the two m ranges shorten the add dependency chain
+                        double sumRe = 0.0, sumIm = 0.0, sumRe2 = 0.0, sumIm2 = 0.0;
+                        for (int n = 0; n < P; ++n) {
+                            const double* Mn = Mre + n * (n + 1);          // M[n, 0]
+                            const double* Yn = Y + 2 * ((j + n) * (j + n) + j + n - k); // Y[j+n, -k]
+                            // m < 0: conj(M[n, -m])
+                            for (int m = -n; m < 0; ++m) {
+                                const double mr = Mn[-2 * m];
+                                const double mi = -Mn[-2 * m + 1];
+                                const double yr = Yn[2 * m];
+                                const double yi = Yn[2 * m + 1];
+                                sumRe += mr * yr - mi * yi;
+                                sumIm += mr * yi + mi * yr;
+                            }
+                            // m >= 0: sign is (-1)^m up to k, then (-1)^k
+                            double sign = 1.0;
+                            for (int m = 0; m <= n; ++m) {
+                                const double mr = sign * Mn[2 * m];
+                                const double mi = sign * Mn[2 * m + 1];
+                                const double yr = Yn[2 * m];
+                                const double yi = Yn[2 * m + 1];
+                                sumRe2 += mr * yr - mi * yi;
+                                sumIm2 += mr * yi + mi * yr;
+                                if (m < k) sign = -sign;
+                            }
+                        }
+                        const double Cnm = oddOrEven(j);
+                        L[j * (j + 1) / 2 + k] += Complex(Cnm * (sumRe + sumRe2), Cnm * (sumIm + sumIm2));
+                    }
+                }
+            }
+        }
+    });
+}
+
+void FmmGravity::downwardPass()
+{
+    PROFILE_FINE_SCOPE("fmm.downward");
+
+    const int P = m_terms;
+
+    // L2L: top level first, each child gathers its parent's local expansion
+    for (size_t level = 1; level + 1 < m_levelBegin.size(); ++level) {
+        const size_t first = m_levelBegin[level];
+        const size_t count = m_levelBegin[level + 1] - first;
+        ThreadPool::instance().parallelFor(count, LEAF_GRAIN, [this, P, first](size_t begin, size_t end) {
+            std::vector<Complex> Ynm(P * P), YnmTheta(P * P);
+            for (size_t i = begin; i < end; ++i) {
+                const int c = static_cast<int>(first + i);
+                const Cell& cell = m_cells[c];
+                const Cell& parent = m_cells[cell.parent];
+                const Complex* Lj = local(cell.parent);
+                Complex* Li = local(c);
+                double rho, alpha, beta;
+                cartesianToSpherical(cell.center[0] - parent.center[0], cell.center[1] - parent.center[1],
+                                     cell.center[2] - parent.center[2], rho, alpha, beta);
+                evalMultipole(P, rho, alpha, beta, Ynm.data(), YnmTheta.data());
+                for (int j = 0; j < P; ++j) {
+                    for (int k = 0; k <= j; ++k) {
+                        Complex sum = 0;
+                        for (int n = j; n < P; ++n) {
+                            for (int m = j + k - n; m < 0; ++m) {
+                                const int jnkm = (n - j) * (n - j) + n - j + m - k;
+                                sum += std::conj(Lj[n * (n + 1) / 2 - m]) * Ynm[jnkm] * oddOrEven(k);
+                            }
+                            for (int m = 0; m <= n; ++m) {
+                                if (n - j >= std::abs(m - k)) {
+                                    const int jnkm = (n - j) * (n - j) + n - j + m - k;
+                                    sum += Lj[n * (n + 1) / 2 + m] * Ynm[jnkm] * oddOrEven((m - k) * (m < k));
+                                }
+                            }
+                        }
+                        Li[j * (j + 1) / 2 + k] += sum;
+                    }
+                }
+            }
+        });
+    }
+}
+
+void FmmGravity::nearFieldPass()
+{
+    PROFILE_FINE_SCOPE("fmm.near");
+
+    const int P = m_terms;
+    const double minSeparation = m_minSeparation / m_lengthScale;
+    const double minSeparationSq = minSeparation * minSeparation;
+
+    ThreadPool::instance().parallelFor(m_leaves.size(), LEAF_GRAIN, [this, P, minSeparationSq](size_t begin, size_t end) {
+        std::vector<Complex> Ynm(P * P), YnmTheta(P * P);
+        const Complex I(0.0, 1.0);
+        for (size_t l = begin; l < end; ++l) {
+            const int c = m_leaves[l];
+            const Cell& cell = m_cells[c];
+            const Complex* L = local(c);
+
+            for (size_t i = cell.bodyBegin; i < cell.bodyBegin + cell.bodyCount; ++i) {
+                // L2P: gradient of the local expansion
+                double dx = m_x[i] - cell.center[0];
+                const double dy = m_y[i] - cell.center[1];
+                const double dz = m_z[i] - cell.center[2];
+                // The spherical gradient is singular on the polar axis; the expansion is smooth,
+                // so evaluate a negligible distance off-axis instead
+                if (dx * dx + dy * dy < 1e-24 * cell.halfWidth * cell.halfWidth) {
+                    dx += 1e-12 * cell.halfWidth;
+                }
+                double r, theta, phi;
+                cartesianToSpherical(dx, dy, dz, r, theta, phi);
+                evalMultipole(P, r, theta, phi, Ynm.data(), YnmTheta.data());
+
+                double sr = 0.0, st = 0.0, sp = 0.0;
+                for (int n = 0; n < P; ++n) {
+                    int nm = n * n + n;
+                    int nms = n * (n + 1) / 2;
+                    sr += std::real(L[nms] * Ynm[nm]) / r * n;
+                    st += std::real(L[nms] * YnmTheta[nm]);
+                    for (int m = 1; m <= n; ++m) {
+                        nm = n * n + n + m;
+                        nms = n * (n + 1) / 2 + m;
+                        sr += 2 * std::real(L[nms] * Ynm[nm]) / r * n;
+                        st += 2 * std::real(L[nms] * YnmTheta[nm]);
+                        sp += 2 * std::real(L[nms] * Ynm[nm] * I) * m;
+                    }
+                }
+                const double sinTheta = std::sin(theta), cosTheta = std::cos(theta);
+                const double sinPhi = std::sin(phi), cosPhi = std::cos(phi);
+                double ax = sinTheta * cosPhi * sr + cosTheta * cosPhi / r * st - sinPhi / r / sinTheta * sp;
+                double ay = sinTheta * sinPhi * sr + cosTheta * sinPhi / r * st + cosPhi / r / sinTheta * sp;
+                double az = cosTheta * sr - sinTheta / r * st;
+
+                // P2P: direct sum over the near leaves
+                const double xi = m_x[i], yi = m_y[i], zi = m_z[i];
+                for (int source : m_nearList[c]) {
+                    const Cell& near = m_cells[source];
+                    for (size_t j = near.bodyBegin; j < near.bodyBegin + near.bodyCount; ++j) {
+                        const double rx = m_x[j] - xi;
+                        const double ry = m_y[j] - yi;
+                        const double rz = m_z[j] - zi;
+                        const double rSq = rx * rx + ry * ry + rz * rz;
+                        if (rSq < minSeparationSq || rSq == 0.0) continue;
+                        const double invR = 1.0 / std::sqrt(rSq);
+                        const double factor = m_mass[j] * invR * invR * invR;
+                        ax += factor * rx;
+                        ay += factor * ry;
+                        az += factor * rz;
+                    }
+                }
+
+                m_ax[i] = ax;
+                m_ay[i] = ay;
+                m_az[i] = az;
+            }
+        }
+    });
+}
+
+void FmmGravity::directAccelerations(const std::vector<double>& positions,
+                                     const std::vector<double>& masses,
+                                     const std::vector<size_t>& targets,
+                                     std::vector<double>& accelerations) const
+{
+    const double minSeparationSq = m_minSeparation * m_minSeparation;
+    accelerations.assign(3 * targets.size(), 0.0);
+
+    ThreadPool::instance().parallelFor(targets.size(), LEAF_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            const size_t i = targets[t];
+            double ax = 0.0, ay = 0.0, az = 0.0;
+            for (size_t j = 0; j < masses.size(); ++j) {
+                const double rx = positions[3 * j + 0] - positions[3 * i + 0];
+                const double ry = positions[3 * j + 1] - positions[3 * i + 1];
+                const double rz = positions[3 * j + 2] - positions[3 * i + 2];
+                const double rSq = rx * rx + ry * ry + rz * rz;
+                if (j == i || rSq < minSeparationSq) continue;
+                const double invR = 1.0 / std::sqrt(rSq);
+                const double factor = masses[j] * invR * invR * invR;
+                ax += factor * rx;
+                ay += factor * ry;
+                az += factor * rz;
+            }
+            accelerations[3 * t + 0] = ax;
+            accelerations[3 * t + 1] = ay;
+            accelerations[3 * t + 2] = az;
+        }
+    });
+}
+
+FmmGravity::ErrorReport FmmGravity::measureError(const std::vector<double>& positions,
+                                                 const std::vector<double>& masses,
+                                                 size_t sampleCount)
+{
+    ErrorReport report = { 0.0, 0.0, 0 };
+    const size_t bodyCount = masses.size();
+    if (bodyCount == 0 || sampleCount == 0) {
+        return report;
+    }
+
+    std::vector<double> fmmAccelerations;
+    computeAccelerations(positions, masses, fmmAccelerations);
+
+    std::vector<size_t> targets;
+    const size_t stride = std::max<size_t>(1, bodyCount / sampleCount);
+    for (size_t i = 0; i < bodyCount && targets.size() < sampleCount; i += stride) {
+        targets.push_back(i);
+    }
+    std::vector<double> directAccel;
+    directAccelerations(positions, masses, targets, directAccel);
+
+    double sumSq = 0.0;
+    for (size_t t = 0; t < targets.size(); ++t) {
+        const size_t i = targets[t];
+        double errorSq = 0.0, referenceSq = 0.0;
+        for (int d = 0; d < 3; ++d) {
+            const double difference = fmmAccelerations[3 * i + d] - directAccel[3 * t + d];
+            errorSq += difference * difference;
+            referenceSq += directAccel[3 * t + d] * directAccel[3 * t + d];
+        }
+        if (referenceSq == 0.0) continue;
+        const double relative = std::sqrt(errorSq / referenceSq);
+        sumSq += relative * relative;
+        report.maxRelativeError = std::max(report.maxRelativeError, relative);
+        ++report.sampleCount;
+    }
+    report.rmsRelativeError = report.sampleCount ? std::sqrt(sumSq / report.sampleCount) : 0.0;
+    return report;
+}
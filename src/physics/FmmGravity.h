@@ -0,0 +1,113 @@
+#ifndef FMMGRAVITY_H
+#define FMMGRAVITY_H
+
+#include <complex>
+#include <vector>
+
+// Fast Multipole Method for Newtonian gravity.
+//
+// Bodies are partitioned into an adaptive octree (cells split until they hold at most
+// leafSize bodies). Each cell carries a spherical-harmonic multipole expansion of its mass
+// and a local expansion of the far field; a dual tree traversal decides, per cell pair,
+// whether to interact through expansions (M2L) or by direct summation (P2P).
+// Cost is O(N) for a fixed order; the force error is controlled by the expansion order
+// and the opening angle. All passes run on ThreadPool::instance().
+//
+// Positions and accelerations are packed xyz triples in double precision. The result is
+// the "unit G" field sum_j m_j (x_j - x_i) / |x_j - x_i|^3; multiply by G for m/s^2.
+class FmmGravity
+{
+public:
+    // Accuracy of a solve against direct summation on a sample of bodies
+    struct ErrorReport
+    {
+        double rmsRelativeError;
+        double maxRelativeError;
+        size_t sampleCount;
+    };
+
+    static constexpr int MAX_ORDER = 16;
+
+    explicit FmmGravity(int order = 6, int leafSize = 64, double openingAngle = 0.5);
+
+    // Highest spherical-harmonic degree kept in the expansions (clamped to 1..MAX_ORDER)
+    void setOrder(int order);
+    int getOrder() const { return m_order; }
+
+    // Maximum number of bodies in a leaf cell
+    void setLeafSize(int leafSize);
+    int getLeafSize() const { return m_leafSize; }
+
+    // Two cells interact through expansions when (R_a + R_b) < theta * distance
+    void setOpeningAngle(double theta);
+    double getOpeningAngle() const { return m_theta; }
+
+    // Pairs closer than this are skipped, matching the direct kernel's singularity guard
+    void setMinimumSeparation(double meters) { m_minSeparation = meters; }
+
+    void computeAccelerations(const std::vector<double>& positions,
+                              const std::vector<double>& masses,
+                              std::vector<double>& accelerations);
+
+    // Reference O(N) per target direct summation for the given target indices
+    void directAccelerations(const std::vector<double>& positions,
+                             const std::vector<double>& masses,
+                             const std::vector<size_t>& targets,
+                             std::vector<double>& accelerations) const;
+
+    // Runs a solve and compares it against direct summation on up to sampleCount
+    // evenly spaced bodies.
+    ErrorReport measureError(const std::vector<double>& positions,
+                             const std::vector<double>& masses,
+                             size_t sampleCount = 1000);
+
+    size_t getCellCount() const { return m_cells.size(); }
+
+private:
+    struct Cell
+    {
+        double center[3];
+        double halfWidth;   // Half the edge length of the octree cube
+        double radius;      // Distance from center to the furthest body in the cell
+        size_t bodyBegin;   // Range in the tree-ordered body arrays
+        size_t bodyCount;
+        int childBegin;     // Children are stored contiguously; -1 for a leaf
+        int childCount;
+        int parent;
+    };
+
+    void buildTree(size_t bodyCount);
+    void buildInteractionLists();
+    void traverse(int targetCell, int sourceCell);
+
+    void upwardPass();
+    void farFieldPass();
+    void downwardPass();
+    void nearFieldPass();
+
+    std::complex<double>* multipole(int cell) { return &m_multipoles[static_cast<size_t>(cell) * m_coefficientCount]; }
+    std::complex<double>* local(int cell) { return &m_locals[static_cast<size_t>(cell) * m_coefficientCount]; }
+
+    int m_order;
+    int m_leafSize;
+    double m_theta;
+    double m_minSeparation;
+    int m_terms;              // m_order + 1 degrees (0..m_order)
+    size_t m_coefficientCount; // Stored (n, m >= 0) coefficients per expansion
+
+    // Bodies in tree order, scaled so the root cell is a unit cube
+    std::vector<size_t> m_treeToInput;
+    std::vector<double> m_x, m_y, m_z, m_mass;
+    std::vector<double> m_ax, m_ay, m_az;
+    double m_lengthScale;
+
+    std::vector<Cell> m_cells;
+    std::vector<size_t> m_levelBegin;  // Cells are stored level by level
+    std::vector<int> m_leaves;
+    std::vector<std::complex<double>> m_multipoles;
+    std::vector<std::complex<double>> m_locals;
+    std::vector<std::vector<int>> m_farList;   // M2L sources per target cell
+    std::vector<std::vector<int>> m_nearList;  // P2P sources per target leaf
+};
+
+#endif // FMMGRAVITY_H
@@ -0,0 +1,139 @@
+#include "KeplerOrbit.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const int MAX_ITERATIONS = 50;
+const double TOLERANCE = 1e-12; // Relative change in the universal anomaly
+const double PI = 3.14159265358979323846;
+
+double dot(const double a[3], const double b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Stumpff functions C(z) and S(z), by series near z = 0 where the closed forms cancel badly
+void stumpff(double z, double& c, double& s)
+{
+    if (z > 1e-3) {
+        const double root = std::sqrt(z);
+        c = (1.0 - std::cos(root)) / z;
+        s = (root - std::sin(root)) / (root * root * root);
+    } else if (z < -1e-3) {
+        const double root = std::sqrt(-z);
+        c = (std::cosh(root) - 1.0) / -z;
+        s = (std::sinh(root) - root) / (root * root * root);
+    } else {
+        c = 1.0 / 2.0 - z / 24.0 + z * z / 720.0 - z * z * z / 40320.0;
+        s = 1.0 / 6.0 - z / 120.0 + z * z / 5040.0 - z * z * z / 362880.0;
+    }
+}
+
+} // namespace
+
+KeplerOrbit::KeplerOrbit()
+    : m_mu(0.0),
+      m_epoch(0.0),
+      m_position{0.0, 0.0, 0.0},
+      m_velocity{0.0, 0.0, 0.0},
+      m_radius(0.0),
+      m_radialRate(0.0),
+      m_alpha(0.0)
+{
+}
+
+void KeplerOrbit::setEpochState(double mu, const double position[3], const double velocity[3], double epoch)
+{
+    m_mu = mu;
+    m_epoch = epoch;
+    for (int i = 0; i < 3; ++i) {
+        m_position[i] = position[i];
+        m_velocity[i] = velocity[i];
+    }
+    m_radius = std::sqrt(dot(position, position));
+    m_radialRate = dot(position, velocity) / std::sqrt(mu);
+    m_alpha = 2.0 / m_radius - dot(velocity, velocity) / mu;
+}
+
+bool KeplerOrbit::stateAt(double time, double position[3], double velocity[3]) const
+{
+    const double sqrtMu = std::sqrt(m_mu);
+    double dt = time - m_epoch;
+
+    // Whole revolutions of an ellipse change nothing, and dropping them keeps the first guess good
+    if (m_alpha * m_radius > 1e-9) {
+        const double period = 2.0 * PI / (sqrtMu * m_alpha * std::sqrt(m_alpha));
+        dt = std::fmod(dt, period);
+    }
+
+    // Initial guess for the universal anomaly chi
+    double chi = sqrtMu * dt / m_radius;
+    if (m_alpha * m_radius > 1e-6) {
+        chi = sqrtMu * m_alpha * dt;
+    } else if (m_alpha * m_radius < -1e-6 && dt != 0.0) {
+        const double a = 1.0 / m_alpha;
+        const double sign = dt > 0.0 ? 1.0 : -1.0;
+        const double argument = (-2.0 * m_mu * m_alpha * dt) /
+                                (m_radialRate * sqrtMu + sign * std::sqrt(-m_mu * a) * (1.0 - m_radius * m_alpha));
+        if (argument > 0.0) {
+            chi = sign * std::sqrt(-a) * std::log(argument);
+        }
+    }
+
+    // Newton on sqrt(mu) dt = chi^3 S + (r.v / sqrt(mu)) chi^2 C + r0 chi (1 - z S), z = alpha chi^2,
+    // whose derivative with respect to chi is the radius at the solution
+    double z = 0.0, c = 0.5, s = 1.0 / 6.0, radius = m_radius;
+    bool converged = false;
+    for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+        z = m_alpha * chi * chi;
+        stumpff(z, c, s);
+        const double chiSq = chi * chi;
+        radius = chiSq * c + m_radialRate * chi * (1.0 - z * s) + m_radius * (1.0 - z * c);
+        const double residual = sqrtMu * dt - (chiSq * chi * s + m_radialRate * chiSq * c + m_radius * chi * (1.0 - z * s));
+        const double delta = residual / radius;
+        chi += delta;
+        if (std::fabs(delta) <= TOLERANCE * std::max(std::fabs(chi), 1.0)) {
+            converged = true;
+            break;
+        }
+    }
+    if (!converged || !std::isfinite(chi)) {
+        return false;
+    }
+
+    z = m_alpha * chi * chi;
+    stumpff(z, c, s);
+    const double chiSq = chi * chi;
+    radius = chiSq * c + m_radialRate * chi * (1.0 - z * s) + m_radius * (1.0 - z * c);
+
+    // Lagrange coefficients
+    const double f = 1.0 - chiSq * c / m_radius;
+    const double g = dt - chiSq * chi * s / sqrtMu;
+    const double fDot = sqrtMu * chi * (z * s - 1.0) / (radius * m_radius);
+    const double gDot = 1.0 - chiSq * c / radius;
+    for (int i = 0; i < 3; ++i) {
+        position[i] = f * m_position[i] + g * m_velocity[i];
+        velocity[i] = fDot * m_position[i] + gDot * m_velocity[i];
+    }
+    return true;
+}
+
+double KeplerOrbit::getSemiMajorAxis() const
+{
+    return m_alpha != 0.0 ? 1.0 / m_alpha : std::numeric_limits<double>::infinity();
+}
+
+double KeplerOrbit::getEccentricity() const
+{
+    // |e| with e = ((v^2 - mu/r) r - (r.v) v) / mu
+    const double vSq = dot(m_velocity, m_velocity);
+    const double rDotV = dot(m_position, m_velocity);
+    double eSq = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        const double e = ((vSq - m_mu / m_radius) * m_position[i] - rDotV * m_velocity[i]) / m_mu;
+        eSq += e * e;
+    }
+    return std::sqrt(eSq);
+}
@@ -0,0 +1,35 @@
+#ifndef KEPLERORBIT_H
+#define KEPLERORBIT_H
+
+// Two-body orbit about a central mass, propagated analytically with the universal-variable
+// form of Kepler's equation, so elliptic, parabolic and hyperbolic orbits share one solver.
+//
+// The orbit is defined by its osculating state (relative position and velocity) at an
+// epoch. Resetting that state re-osculates the orbit, which is how NBodySimulation folds
+// in perturbations from the other bodies.
+class KeplerOrbit
+{
+public:
+    KeplerOrbit();
+
+    // mu = G * (central mass + orbiting mass), in m^3/s^2
+    void setEpochState(double mu, const double position[3], const double velocity[3], double epoch);
+
+    // Relative state at `time`. Returns false if Kepler's equation did not converge.
+    bool stateAt(double time, double position[3], double velocity[3]) const;
+
+    double getEpoch() const { return m_epoch; }
+    double getSemiMajorAxis() const;  // Negative for hyperbolic orbits, infinite for parabolic
+    double getEccentricity() const;
+
+private:
+    double m_mu;
+    double m_epoch;
+    double m_position[3];
+    double m_velocity[3];
+    double m_radius;         // |position| at the epoch
+    double m_radialRate;     // position . velocity / sqrt(mu)
+    double m_alpha;          // 2/r - v^2/mu, the reciprocal of the semi-major axis
+};
+
+#endif // KEPLERORBIT_H
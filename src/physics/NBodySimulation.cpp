@@ -1,4 +1,5 @@
 #include "NBodySimulation.h"
+#include "../profiling/Profiler.h"
 #include <QDebug>
 #include <cmath>
 
@@ -9,7 +10,11 @@ NBodySimulation::NBodySimulation(QObject* parent)
       m_baseTimeStep(3600),     // Base time unit: 1 hour
       m_timeScale(1.0),         // Initial speed multiplier
       m_maxTimeStep(3600 * 24), // Maximum safe timestep: 1 day
-      m_subSteps(1)             // Initial substeps
+      m_subSteps(1),            // Initial substeps
+      m_forceSolver(ForceSolver::Direct),
+      m_fixedSizeKernelsEnabled(true),
+      m_keplerRefreshInterval(3600 * 24 * 100), // Re-osculate Kepler orbits every 100 days
+      m_simulationTime(0)
 {
     // Set up a timer to drive the simulation loop
     m_timer.setInterval(16); // ~60 FPS for smooth animation
@@ -20,6 +25,11 @@ NBodySimulation::NBodySimulation(QObject* parent)
 void NBodySimulation::addBody(CelestialBody& body)
 {
     m_bodies.push_back(body);
+    m_bodies.back().resetTrail(m_simulationTime);
+    // New bodies are integrated; appending keeps building a large catalogue linear
+    m_keplerPropagated.push_back(false);
+    m_integratedBodies.push_back(m_bodies.size() - 1);
+    m_fixedEngine.reset();
 }
 
 // Note: The return type is now a non-const reference
@@ -30,22 +40,28 @@ std::vector<CelestialBody>& NBodySimulation::getBodies()
 
 void NBodySimulation::start()
 {
-    m_timer.start();
+    play();
 }
 
 void NBodySimulation::stop()
 {
-    m_timer.stop();
+    pause();
 }
 
 void NBodySimulation::play()
 {
-    m_timer.start();
+    if (!m_timer.isActive()) {
+        m_timer.start();
+        emit runningChanged(true);
+    }
 }
 
 void NBodySimulation::pause()
 {
-    m_timer.stop();
+    if (m_timer.isActive()) {
+        m_timer.stop();
+        emit runningChanged(false);
+    }
 }
 
 void NBodySimulation::setTimeScale(int scalePercentage)
@@ -100,70 +116,438 @@ void NBodySimulation::setTimeScaleAlternative(int scalePercentage)
     }
 }
 
-void NBodySimulation::step()
+void NBodySimulation::packBodies()
 {
-    // Calculate the actual timestep for each substep
-    double totalTimePerFrame = m_baseTimeStep * m_timeScale;
-    double dt = totalTimePerFrame / m_subSteps;
-    
-    // Perform multiple small steps instead of one large step
-    for (int substep = 0; substep < m_subSteps; ++substep) {
-        std::vector<QVector3D> currentAccelerations;
-        std::vector<QVector3D> newAccelerations;
+    m_packedPositions.resize(3 * m_integratedBodies.size());
+    m_packedMasses.resize(m_integratedBodies.size());
+    for (size_t i = 0; i < m_integratedBodies.size(); ++i) {
+        const CelestialBody& body = m_bodies[m_integratedBodies[i]];
+        const QVector3D position = body.getPosition();
+        m_packedPositions[3 * i + 0] = position.x();
+        m_packedPositions[3 * i + 1] = position.y();
+        m_packedPositions[3 * i + 2] = position.z();
+        m_packedMasses[i] = body.getMass();
+    }
+}
+
+FmmGravity::ErrorReport NBodySimulation::validateFmm(size_t sampleCount)
+{
+    packBodies();
+    return m_fmm.measureError(m_packedPositions, m_packedMasses, sampleCount);
+}
+
+void NBodySimulation::computeAccelerations(std::vector<QVector3D>& accelerations)
+{
+    accelerations.clear();
+    accelerations.reserve(m_integratedBodies.size());
+
+    if (m_forceSolver == ForceSolver::FastMultipole) {
+        packBodies();
+        m_fmm.computeAccelerations(m_packedPositions, m_packedMasses, m_packedAccelerations);
+        for (size_t i = 0; i < m_integratedBodies.size(); ++i) {
+            accelerations.push_back(QVector3D(G * m_packedAccelerations[3 * i + 0],
+                                              G * m_packedAccelerations[3 * i + 1],
+                                              G * m_packedAccelerations[3 * i + 2]));
+        }
+        return;
+    }
+
+    for (size_t i : m_integratedBodies) {
+        QVector3D totalForce(0, 0, 0);
+        for (size_t j : m_integratedBodies) {
+            if (i == j) continue;
+            QVector3D r = m_bodies[j].getPosition() - m_bodies[i].getPosition();
+            double r_sq = QVector3D::dotProduct(r, r);
+            if (r_sq < 1e6) continue; // Avoid singularity (1km minimum distance)
+            double r_mag = std::sqrt(r_sq);
+            double F_mag = (G * m_bodies[i].getMass() * m_bodies[j].getMass()) / r_sq;
+            QVector3D F = (F_mag / r_mag) * r;
+            totalForce += F;
+        }
+        accelerations.push_back(totalForce / m_bodies[i].getMass());
+    }
+}
+
+bool NBodySimulation::prepareFixedEngine()
+{
+    if (!m_fixedEngine || m_fixedEngine->getBodyCount() != m_integratedBodies.size()) {
+        m_fixedEngine = FixedNBodyEngine::create(m_integratedBodies.size(), 1);
+        if (!m_fixedEngine) {
+            return false; // No specialisation for this many bodies
+        }
+        loadFixedEngine();
+        return true;
+    }
+
+    // Reload if a body was changed outside step() since the engine last stored its state
+    FixedNBodyEngine& engine = *m_fixedEngine;
+    for (size_t k = 0; k < m_integratedBodies.size(); ++k) {
+        const CelestialBody& body = m_bodies[m_integratedBodies[k]];
+        const QVector3D position(*engine.lanes(FixedNBodyEngine::PositionX, k),
+                                 *engine.lanes(FixedNBodyEngine::PositionY, k),
+                                 *engine.lanes(FixedNBodyEngine::PositionZ, k));
+        const QVector3D velocity(*engine.lanes(FixedNBodyEngine::VelocityX, k),
+                                 *engine.lanes(FixedNBodyEngine::VelocityY, k),
+                                 *engine.lanes(FixedNBodyEngine::VelocityZ, k));
+        if (body.getPosition() != position || body.getVelocity() != velocity) {
+            loadFixedEngine();
+            break;
+        }
+    }
+    return true;
+}
+
+void NBodySimulation::loadFixedEngine()
+{
+    FixedNBodyEngine& engine = *m_fixedEngine;
+    for (size_t k = 0; k < m_integratedBodies.size(); ++k) {
+        const CelestialBody& body = m_bodies[m_integratedBodies[k]];
+        *engine.lanes(FixedNBodyEngine::PositionX, k) = body.getPosition().x();
+        *engine.lanes(FixedNBodyEngine::PositionY, k) = body.getPosition().y();
+        *engine.lanes(FixedNBodyEngine::PositionZ, k) = body.getPosition().z();
+        *engine.lanes(FixedNBodyEngine::VelocityX, k) = body.getVelocity().x();
+        *engine.lanes(FixedNBodyEngine::VelocityY, k) = body.getVelocity().y();
+        *engine.lanes(FixedNBodyEngine::VelocityZ, k) = body.getVelocity().z();
+        engine.setGravitationalParameter(k, G * body.getMass());
+    }
+    engine.stateChanged();
+}
+
+void NBodySimulation::stepFixed(double dt, int substeps)
+{
+    FixedNBodyEngine& engine = *m_fixedEngine;
+    for (int substep = 0; substep < substeps; ++substep) {
+        // One substep at a time so the trails see every substep; the engine keeps its
+        // accelerations between calls, so this costs the same as a single advance()
+        engine.advance(dt, 1);
+        m_simulationTime += dt;
+
+        for (size_t k = 0; k < m_integratedBodies.size(); ++k) {
+            CelestialBody& body = m_bodies[m_integratedBodies[k]];
+            body.setPosition(QVector3D(*engine.lanes(FixedNBodyEngine::PositionX, k),
+                                       *engine.lanes(FixedNBodyEngine::PositionY, k),
+                                       *engine.lanes(FixedNBodyEngine::PositionZ, k)));
+            body.setVelocity(QVector3D(*engine.lanes(FixedNBodyEngine::VelocityX, k),
+                                       *engine.lanes(FixedNBodyEngine::VelocityY, k),
+                                       *engine.lanes(FixedNBodyEngine::VelocityZ, k)));
+        }
+        sampleTrails();
+    }
+}
+
+void NBodySimulation::sampleTrails()
+{
+    PROFILE_FINE_SCOPE("step.trails");
+    for (size_t i : m_integratedBodies) {
+        m_bodies[i].sampleTrail(m_simulationTime);
+    }
+}
+
+void NBodySimulation::rebuildIntegratedBodies()
+{
+    m_integratedBodies.clear();
+    for (size_t i = 0; i < m_bodies.size(); ++i) {
+        if (!m_keplerPropagated[i]) {
+            m_integratedBodies.push_back(i);
+        }
+    }
+    m_fixedEngine.reset();
+}
+
+size_t NBodySimulation::heaviestIntegratedBody() const
+{
+    size_t heaviest = m_bodies.size();
+    for (size_t i : m_integratedBodies) {
+        if (heaviest == m_bodies.size() || m_bodies[i].getMass() > m_bodies[heaviest].getMass()) {
+            heaviest = i;
+        }
+    }
+    return heaviest;
+}
+
+bool NBodySimulation::isKeplerPropagated(size_t bodyIndex) const
+{
+    return bodyIndex < m_keplerPropagated.size() && m_keplerPropagated[bodyIndex];
+}
+
+NBodySimulation::Barycentre NBodySimulation::integratedBarycentre() const
+{
+    Barycentre centre = {};
+    for (size_t i : m_integratedBodies) {
+        const CelestialBody& body = m_bodies[i];
+        const double m = body.getMass();
+        centre.position[0] += m * body.getPosition().x();
+        centre.position[1] += m * body.getPosition().y();
+        centre.position[2] += m * body.getPosition().z();
+        centre.velocity[0] += m * body.getVelocity().x();
+        centre.velocity[1] += m * body.getVelocity().y();
+        centre.velocity[2] += m * body.getVelocity().z();
+        centre.mass += m;
+    }
+    if (centre.mass > 0.0) {
+        for (int c = 0; c < 3; ++c) {
+            centre.position[c] /= centre.mass;
+            centre.velocity[c] /= centre.mass;
+        }
+    }
+    return centre;
+}
+
+void NBodySimulation::setKeplerPropagation(size_t bodyIndex, bool enabled)
+{
+    if (bodyIndex >= m_bodies.size() || enabled == isKeplerPropagated(bodyIndex)) {
+        return;
+    }
+
+    if (enabled) {
+        if (bodyIndex != heaviestIntegratedBody()) {
+            beginKeplerTracks({ bodyIndex });
+        }
+        return;
+    }
+
+    for (size_t t = 0; t < m_keplerTracks.size(); ++t) {
+        if (m_keplerTracks[t].body != bodyIndex) continue;
+
+        // Closing half-kick, then the body goes back to the integrator
+        const Barycentre centre = integratedBarycentre();
+        double position[3], velocity[3], acceleration[3];
+        relativeState(bodyIndex, centre, position, velocity);
+        perturbingAcceleration(centre, position, acceleration);
+        const double kickDuration = 0.5 * (m_simulationTime - m_keplerTracks[t].lastRefresh);
+        CelestialBody& body = m_bodies[bodyIndex];
+        body.setVelocity(body.getVelocity() + kickDuration * QVector3D(acceleration[0], acceleration[1], acceleration[2]));
+        m_keplerTracks.erase(m_keplerTracks.begin() + t);
+        break;
+    }
+    m_keplerPropagated[bodyIndex] = false;
+    rebuildIntegratedBodies();
+}
+
+size_t NBodySimulation::setKeplerPropagationBeyond(double minimumDistance, double maximumMass)
+{
+    const Barycentre centre = integratedBarycentre();
+    const QVector3D barycentre(centre.position[0], centre.position[1], centre.position[2]);
+    const size_t heaviest = heaviestIntegratedBody();
+
+    std::vector<size_t> distant;
+    for (size_t i : m_integratedBodies) {
+        if (i != heaviest && m_bodies[i].getMass() <= maximumMass &&
+            (m_bodies[i].getPosition() - barycentre).length() > minimumDistance) {
+            distant.push_back(i);
+        }
+    }
+    if (!distant.empty()) {
+        beginKeplerTracks(distant);
+    }
+    return distant.size();
+}
+
+void NBodySimulation::beginKeplerTracks(const std::vector<size_t>& bodies)
+{
+    // Leave the bodies out of the barycentre they will orbit, with one rebuild for all of them
+    for (size_t i : bodies) {
+        m_keplerPropagated[i] = true;
+        KeplerTrack track;
+        track.body = i;
+        m_keplerTracks.push_back(track);
+    }
+    rebuildIntegratedBodies();
+
+    const Barycentre centre = integratedBarycentre();
+    for (size_t t = m_keplerTracks.size() - bodies.size(); t < m_keplerTracks.size(); ++t) {
+        double position[3], velocity[3];
+        relativeState(m_keplerTracks[t].body, centre, position, velocity);
+        // Opening half-kick of the perturbation leapfrog
+        osculate(m_keplerTracks[t], centre, position, velocity, 0.5 * m_keplerRefreshInterval);
+    }
+}
+
+void NBodySimulation::relativeState(size_t bodyIndex, const Barycentre& centre, double position[3], double velocity[3]) const
+{
+    const CelestialBody& body = m_bodies[bodyIndex];
+    position[0] = body.getPosition().x() - centre.position[0];
+    position[1] = body.getPosition().y() - centre.position[1];
+    position[2] = body.getPosition().z() - centre.position[2];
+    velocity[0] = body.getVelocity().x() - centre.velocity[0];
+    velocity[1] = body.getVelocity().y() - centre.velocity[1];
+    velocity[2] = body.getVelocity().z() - centre.velocity[2];
+}
+
+void NBodySimulation::perturbingAcceleration(const Barycentre& centre, const double relativePosition[3],
+                                             double acceleration[3]) const
+{
+    // Pull of every integrated body, minus the point-mass pull of their combined mass at the
+    // barycentre, which the Kepler orbit already contains. What remains is mostly the
+    // quadrupole of the outer planets, which is small and varies slowly.
+    const double rSq = relativePosition[0] * relativePosition[0] + relativePosition[1] * relativePosition[1] +
+                       relativePosition[2] * relativePosition[2];
+    const double monopole = G * centre.mass / (rSq * std::sqrt(rSq));
+    for (int c = 0; c < 3; ++c) {
+        acceleration[c] = monopole * relativePosition[c];
+    }
+
+    for (size_t j : m_integratedBodies) {
+        const QVector3D position = m_bodies[j].getPosition();
+        const double d[3] = { position.x() - centre.position[0] - relativePosition[0],
+                              position.y() - centre.position[1] - relativePosition[1],
+                              position.z() - centre.position[2] - relativePosition[2] };
+        const double dSq = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+        if (dSq < 1e6) continue; // Same 1 km singularity guard as the integrator
+        const double pull = G * m_bodies[j].getMass() / (dSq * std::sqrt(dSq));
+        for (int c = 0; c < 3; ++c) {
+            acceleration[c] += pull * d[c];
+        }
+    }
+}
+
+void NBodySimulation::osculate(KeplerTrack& track, const Barycentre& centre, const double position[3], double velocity[3],
+                               double kickDuration)
+{
+    // The perturbations act as an impulse on the velocity, and the orbit through the kicked
+    // state becomes the new osculating orbit
+    double acceleration[3];
+    perturbingAcceleration(centre, position, acceleration);
+    for (int c = 0; c < 3; ++c) {
+        velocity[c] += acceleration[c] * kickDuration;
+    }
+    track.orbit.setEpochState(G * centre.mass, position, velocity, m_simulationTime);
+    track.lastRefresh = m_simulationTime;
+    track.nextRefresh = m_simulationTime + m_keplerRefreshInterval;
+}
+
+int NBodySimulation::substepsUntilKeplerRefresh(double dt, int remaining) const
+{
+    int substeps = remaining;
+    for (const KeplerTrack& track : m_keplerTracks) {
+        const double untilRefresh = track.nextRefresh - m_simulationTime;
+        const int needed = std::max(1, static_cast<int>(std::ceil(untilRefresh / dt - 1e-9)));
+        substeps = std::min(substeps, needed);
+    }
+    return substeps;
+}
+
+void NBodySimulation::refreshKeplerOrbits()
+{
+    PROFILE_FINE_SCOPE("step.kepler");
+    Barycentre centre;
+    bool haveCentre = false; // Only computed if some track is due
+    for (KeplerTrack& track : m_keplerTracks) {
+        double position[3], velocity[3];
+        if (m_simulationTime < track.nextRefresh || !track.orbit.stateAt(m_simulationTime, position, velocity)) {
+            continue; // A failed solve is reported by placeKeplerBodies()
+        }
+        if (!haveCentre) {
+            centre = integratedBarycentre();
+            haveCentre = true;
+        }
+        // Kicks are centred on refresh times: half of the elapsed interval closes the last
+        // one and half of the nominal interval opens the next
+        osculate(track, centre, position, velocity,
+                 0.5 * (m_simulationTime - track.lastRefresh) + 0.5 * m_keplerRefreshInterval);
+    }
+}
+
+void NBodySimulation::placeKeplerBodies()
+{
+    PROFILE_FINE_SCOPE("step.kepler");
+    const Barycentre centre = integratedBarycentre();
+    for (size_t t = 0; t < m_keplerTracks.size(); ++t) {
+        double position[3], velocity[3];
+        if (!m_keplerTracks[t].orbit.stateAt(m_simulationTime, position, velocity)) {
+            const size_t body = m_keplerTracks[t].body;
+            qWarning() << "Kepler solver did not converge for" << m_bodies[body].getName()
+                       << "- integrating it numerically from its last state";
+            m_keplerTracks.erase(m_keplerTracks.begin() + t);
+            m_keplerPropagated[body] = false;
+            rebuildIntegratedBodies();
+            --t;
+            continue;
+        }
+        CelestialBody& body = m_bodies[m_keplerTracks[t].body];
+        body.setPosition(QVector3D(centre.position[0] + position[0], centre.position[1] + position[1],
+                                   centre.position[2] + position[2]));
+        body.setVelocity(QVector3D(centre.velocity[0] + velocity[0], centre.velocity[1] + velocity[1],
+                                   centre.velocity[2] + velocity[2]));
+        body.sampleTrail(m_simulationTime);
+    }
+}
+
+void NBodySimulation::integrate(double dt, int substeps)
+{
+    if (m_forceSolver == ForceSolver::Direct && m_fixedSizeKernelsEnabled && prepareFixedEngine()) {
+        // Small catalogue: all substeps in the compile-time specialised engine
+        PROFILE_FINE_SCOPE("step.fixed");
+        stepFixed(dt, substeps);
+        return;
+    }
+
+    std::vector<QVector3D> currentAccelerations;
+    std::vector<QVector3D> newAccelerations;
 
+    // Perform multiple small steps instead of one large step
+    for (int substep = 0; substep < substeps; ++substep) {
         // 1. First pass: calculate current accelerations (a(t))
-        for (size_t i = 0; i < m_bodies.size(); ++i) {
-            QVector3D totalForce(0, 0, 0);
-            for (size_t j = 0; j < m_bodies.size(); ++j) {
-                if (i == j) continue;
-                QVector3D r = m_bodies[j].getPosition() - m_bodies[i].getPosition();
-                double r_sq = QVector3D::dotProduct(r, r);
-                if (r_sq < 1e6) continue; // Avoid singularity (1km minimum distance)
-                double r_mag = std::sqrt(r_sq);
-                double F_mag = (G * m_bodies[i].getMass() * m_bodies[j].getMass()) / r_sq;
-                QVector3D F = (F_mag / r_mag) * r;
-                totalForce += F;
-            }
-            currentAccelerations.push_back(totalForce / m_bodies[i].getMass());
+        {
+            PROFILE_FINE_SCOPE("step.forces");
+            computeAccelerations(currentAccelerations);
         }
 
         // 2. Update positions
-        for (size_t i = 0; i < m_bodies.size(); ++i) {
-            QVector3D newPosition = m_bodies[i].getPosition() +
-                                    m_bodies[i].getVelocity() * dt +
-                                    0.5 * currentAccelerations[i] * dt * dt;
-            m_bodies[i].setPosition(newPosition);
-            
-            // Only add to history on the last substep to avoid too many points
-            if (substep == m_subSteps - 1) {
-                m_bodies[i].addPositionToHistory(newPosition);
+        {
+            PROFILE_FINE_SCOPE("step.integrate");
+            for (size_t k = 0; k < m_integratedBodies.size(); ++k) {
+                CelestialBody& body = m_bodies[m_integratedBodies[k]];
+                QVector3D newPosition = body.getPosition() +
+                                        body.getVelocity() * dt +
+                                        0.5 * currentAccelerations[k] * dt * dt;
+                body.setPosition(newPosition);
             }
         }
 
         // 3. Second pass: calculate new accelerations (a(t + dt))
-        for (size_t i = 0; i < m_bodies.size(); ++i) {
-            QVector3D totalForce(0, 0, 0);
-            for (size_t j = 0; j < m_bodies.size(); ++j) {
-                if (i == j) continue;
-                QVector3D r = m_bodies[j].getPosition() - m_bodies[i].getPosition();
-                double r_sq = QVector3D::dotProduct(r, r);
-                if (r_sq < 1e6) continue; // Avoid singularity
-                double r_mag = std::sqrt(r_sq);
-                double F_mag = (G * m_bodies[i].getMass() * m_bodies[j].getMass()) / r_sq;
-                QVector3D F = (F_mag / r_mag) * r;
-                totalForce += F;
-            }
-            newAccelerations.push_back(totalForce / m_bodies[i].getMass());
+        {
+            PROFILE_FINE_SCOPE("step.forces");
+            computeAccelerations(newAccelerations);
         }
 
         // 4. Update velocities
-        for (size_t i = 0; i < m_bodies.size(); ++i) {
-            QVector3D newVelocity = m_bodies[i].getVelocity() +
-                                    0.5 * (currentAccelerations[i] + newAccelerations[i]) * dt;
-            m_bodies[i].setVelocity(newVelocity);
+        {
+            PROFILE_FINE_SCOPE("step.integrate");
+            for (size_t k = 0; k < m_integratedBodies.size(); ++k) {
+                CelestialBody& body = m_bodies[m_integratedBodies[k]];
+                QVector3D newVelocity = body.getVelocity() +
+                                        0.5 * (currentAccelerations[k] + newAccelerations[k]) * dt;
+                body.setVelocity(newVelocity);
+            }
+        }
+
+        m_simulationTime += dt;
+        sampleTrails();
+    }
+}
+
+void NBodySimulation::step()
+{
+    PROFILE_SCOPE("NBodySimulation::step");
+
+    // Calculate the actual timestep for each substep
+    double totalTimePerFrame = m_baseTimeStep * m_timeScale;
+    double dt = totalTimePerFrame / m_subSteps;
+
+    // Substeps run in chunks that end on Kepler refresh times, so perturbations are
+    // sampled from the integrated bodies at a substep boundary. Integrated bodies add
+    // to their trails every substep, and Kepler bodies at the end of every chunk.
+    int remaining = m_subSteps;
+    while (remaining > 0) {
+        const int substeps = substepsUntilKeplerRefresh(dt, remaining);
+        integrate(dt, substeps);
+        remaining -= substeps;
+        if (!m_keplerTracks.empty()) {
+            refreshKeplerOrbits();
+            placeKeplerBodies();
         }
     }
 
     emit simulationStepCompleted();
 }
-
@@ -3,20 +3,57 @@
 
 #include <QObject>
 #include <QTimer>
+#include <memory>
 #include <vector>
 #include "CelestialBody.h"
+#include "FixedNBodyEngine.h"
+#include "FmmGravity.h"
+#include "KeplerOrbit.h"
 
 class NBodySimulation : public QObject
 {
     Q_OBJECT
 
 public:
+    // How step() evaluates gravity: exact pairwise summation, or the O(N)
+    // Fast Multipole Method for large body counts
+    enum class ForceSolver { Direct, FastMultipole };
+
     NBodySimulation(QObject* parent = nullptr);
 
     void addBody(CelestialBody& body);
     std::vector<CelestialBody>& getBodies();
     void start();
     void stop();
+    bool isRunning() const { return m_timer.isActive(); }
+
+    void setForceSolver(ForceSolver solver) { m_forceSolver = solver; }
+    ForceSolver getForceSolver() const { return m_forceSolver; }
+    FmmGravity& getFmmGravity() { return m_fmm; }
+
+    // Direct solves of catalogues up to FixedNBodyEngine::MAX_BODIES use the compile-time
+    // specialised engine unless this is switched off
+    void setFixedSizeKernelsEnabled(bool enabled) { m_fixedSizeKernelsEnabled = enabled; }
+    bool getFixedSizeKernelsEnabled() const { return m_fixedSizeKernelsEnabled; }
+
+    // Hybrid propagation for distant, weakly perturbed bodies. A flagged body is not
+    // integrated. It follows a Kepler orbit about the barycentre and total mass of the
+    // integrated bodies. Every refresh interval the orbit is re-osculated after a velocity
+    // kick from the remaining (non point-mass) part of their pull. Flagged bodies act as
+    // test particles: their own pull on the integrated bodies is neglected. The most massive
+    // integrated body is never flagged, so there is always something to orbit.
+    void setKeplerPropagation(size_t bodyIndex, bool enabled);
+    bool isKeplerPropagated(size_t bodyIndex) const;
+    // Flags every body farther than minimumDistance (meters) from the barycentre and no heavier
+    // than maximumMass (kg), so planets keep their pull; returns how many
+    size_t setKeplerPropagationBeyond(double minimumDistance, double maximumMass);
+    void setKeplerRefreshInterval(double seconds) { m_keplerRefreshInterval = seconds; }
+    double getKeplerRefreshInterval() const { return m_keplerRefreshInterval; }
+
+    double getSimulationTime() const { return m_simulationTime; }
+
+    // Compares an FMM solve of the current bodies against direct summation
+    FmmGravity::ErrorReport validateFmm(size_t sampleCount = 1000);
 
 public slots:
     // controls for the sim
@@ -28,17 +65,72 @@ public slots:
     
 signals:
     void simulationStepCompleted();
+    void runningChanged(bool running); // Emitted by start/play and stop/pause when the state changes
 
 private slots:
     void step();
 
 private:
+    // Centre of mass of the integrated bodies, which Kepler orbits are relative to. Computed
+    // once per refresh or flagging batch and shared by every track in it.
+    struct Barycentre
+    {
+        double position[3];
+        double velocity[3];
+        double mass;
+    };
+
+    struct KeplerTrack
+    {
+        size_t body;
+        KeplerOrbit orbit;  // Relative to the integrated bodies' barycentre, osculating at lastRefresh
+        double lastRefresh; // Simulation time of the last perturbation kick
+        double nextRefresh;
+    };
+
+    void integrate(double dt, int substeps);
+    void computeAccelerations(std::vector<QVector3D>& accelerations);
+    void packBodies();
+    bool prepareFixedEngine();
+    void loadFixedEngine();
+    void stepFixed(double dt, int substeps);
+    void sampleTrails();
+
+    void rebuildIntegratedBodies();
+    size_t heaviestIntegratedBody() const; // m_bodies.size() if none
+    void beginKeplerTracks(const std::vector<size_t>& bodies);
+    Barycentre integratedBarycentre() const;
+    void relativeState(size_t bodyIndex, const Barycentre& centre, double position[3], double velocity[3]) const;
+    void perturbingAcceleration(const Barycentre& centre, const double relativePosition[3], double acceleration[3]) const;
+    void osculate(KeplerTrack& track, const Barycentre& centre, const double position[3], double velocity[3],
+                  double kickDuration);
+    int substepsUntilKeplerRefresh(double dt, int remaining) const;
+    void refreshKeplerOrbits();
+    void placeKeplerBodies();
+
     std::vector<CelestialBody> m_bodies;
     QTimer m_timer;
     double m_baseTimeStep;      // Rename from m_timeStep
     double m_timeScale;
     double m_maxTimeStep;       // Maximum safe timestep for integration
     int m_subSteps;             // Number of physics substeps per frame
+
+    ForceSolver m_forceSolver;
+    FmmGravity m_fmm;
+    // Double-precision copies of the body state handed to the FMM
+    std::vector<double> m_packedPositions;
+    std::vector<double> m_packedMasses;
+    std::vector<double> m_packedAccelerations;
+
+    bool m_fixedSizeKernelsEnabled;
+    // Keeps the double-precision state between frames; m_bodies holds float copies of it
+    std::unique_ptr<FixedNBodyEngine> m_fixedEngine;
+
+    std::vector<size_t> m_integratedBodies; // Indices of the bodies not on Kepler orbits
+    std::vector<KeplerTrack> m_keplerTracks;
+    std::vector<bool> m_keplerPropagated;   // Per body: follows a KeplerTrack instead of being integrated
+    double m_keplerRefreshInterval;
+    double m_simulationTime;    // Seconds since the start
 };
 
 #endif // NBODYSIMULATION_H
\ No newline at end of file
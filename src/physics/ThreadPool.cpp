@@ -0,0 +1,109 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+// Set on pool workers and on a caller while it is inside parallelFor
+thread_local bool t_insideParallelFor = false;
+}
+
+ThreadPool& ThreadPool::instance()
+{
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+ThreadPool::ThreadPool(unsigned threadCount)
+    : m_body(nullptr),
+      m_count(0),
+      m_grain(1),
+      m_next(0),
+      m_pendingWorkers(0),
+      m_generation(0),
+      m_stopping(false)
+{
+    for (unsigned i = 1; i < threadCount; ++i) {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+{
+    grain = std::max<size_t>(1, grain);
+    if (count == 0) {
+        return;
+    }
+
+    if (t_insideParallelFor || m_workers.empty() || count <= grain) {
+        for (size_t begin = 0; begin < count; begin += grain) {
+            body(begin, std::min(count, begin + grain));
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> submitLock(m_submitMutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_body = &body;
+        m_count = count;
+        m_grain = grain;
+        m_next.store(0, std::memory_order_relaxed);
+        m_pendingWorkers = m_workers.size();
+        ++m_generation;
+    }
+    m_wake.notify_all();
+
+    t_insideParallelFor = true;
+    runChunks();
+    t_insideParallelFor = false;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_pendingWorkers == 0; });
+    m_body = nullptr;
+}
+
+void ThreadPool::workerLoop()
+{
+    t_insideParallelFor = true;
+    std::uint64_t seenGeneration = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stopping || m_generation != seenGeneration; });
+            if (m_stopping) {
+                return;
+            }
+            seenGeneration = m_generation;
+        }
+
+        runChunks();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_pendingWorkers == 0) {
+            m_done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runChunks()
+{
+    while (true) {
+        const size_t begin = m_next.fetch_add(m_grain, std::memory_order_relaxed);
+        if (begin >= m_count) {
+            break;
+        }
+        (*m_body)(begin, std::min(m_count, begin + m_grain));
+    }
+}
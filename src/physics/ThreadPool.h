@@ -0,0 +1,54 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for data-parallel physics loops.
+// Workers are created once, so per-step parallel sections do not pay for thread creation.
+class ThreadPool
+{
+public:
+    // Shared pool sized to the machine (one worker per core, minus the calling thread)
+    static ThreadPool& instance();
+
+    explicit ThreadPool(unsigned threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that execute work, including the caller
+    unsigned threadCount() const { return static_cast<unsigned>(m_workers.size()) + 1; }
+
+    // Calls body(begin, end) on chunks of at most `grain` indices covering [0, count)
+    // and returns once every chunk has run. The calling thread takes chunks too.
+    // Nested calls (from inside a body) run serially on the calling thread.
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+private:
+    void workerLoop();
+    void runChunks();
+
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_submitMutex; // One parallelFor at a time
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    const std::function<void(size_t, size_t)>* m_body;
+    size_t m_count;
+    size_t m_grain;
+    std::atomic<size_t> m_next;
+    size_t m_pendingWorkers;
+    std::uint64_t m_generation;
+    bool m_stopping;
+};
+
+#endif // THREADPOOL_H
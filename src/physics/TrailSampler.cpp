@@ -0,0 +1,273 @@
+#include "TrailSampler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+double distance(const QVector3D& a, const QVector3D& b)
+{
+    const double d[3] = { double(b.x()) - a.x(), double(b.y()) - a.y(), double(b.z()) - a.z() };
+    return std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+}
+
+} // namespace
+
+TrailSampler::TrailSampler()
+    : m_points(std::in_place)
+{
+    reset(0.0, QVector3D(), QVector3D());
+}
+
+void TrailSampler::setEnabled(bool enabled)
+{
+    if (enabled == isEnabled()) {
+        return;
+    }
+    m_levels.clear();
+    if (enabled) {
+        // The trail restarts from the last state fed in
+        m_points.emplace(1, Point{ m_lastPosition, m_lastTime });
+    } else {
+        m_points.reset();
+    }
+}
+
+void TrailSampler::reset(double time, const QVector3D& position, const QVector3D& velocity)
+{
+    if (m_points) {
+        m_points->assign(1, Point{ position, time });
+    }
+    m_levels.clear();
+
+    m_lastTime = time;
+    m_lastPosition = position;
+    m_lastVelocity = velocity;
+    m_arcSinceRecord = 0.0;
+}
+
+void TrailSampler::feed(double time, const QVector3D& position, const QVector3D& velocity)
+{
+    if (!m_points) {
+        m_lastTime = time;
+        m_lastPosition = position;
+        m_lastVelocity = velocity;
+        return;
+    }
+
+    const double dt = time - m_lastTime;
+    if (dt < 0.0) {
+        reset(time, position, velocity); // Time ran backwards, so the old trail no longer applies
+        return;
+    }
+    if (dt == 0.0) {
+        return;
+    }
+
+    m_arcSinceRecord += distance(m_lastPosition, position);
+    const double arcStep = std::max(MIN_ARC_LENGTH, ANGULAR_STEP * distance(QVector3D(), position));
+    const double sinceRecord = time - m_points->back().time;
+    const double due = std::floor(std::max(m_arcSinceRecord / arcStep, sinceRecord / MAX_INTERVAL));
+    // Only the newest points survive the length limit, so older ones are not generated
+    const double first = std::max(1.0, due - static_cast<double>(MAX_POINTS) + 1.0);
+
+    // Spread the due points evenly over this substep, the last one at its end. Positions
+    // come from the cubic Hermite curve matching position and velocity at both ends.
+    for (double k = first; k <= due; k += 1.0) {
+        const double s = k / due;
+        const double s2 = s * s;
+        const double s3 = s2 * s;
+        const double h00 = 2.0 * s3 - 3.0 * s2 + 1.0;
+        const double h10 = (s3 - 2.0 * s2 + s) * dt;
+        const double h01 = -2.0 * s3 + 3.0 * s2;
+        const double h11 = (s3 - s2) * dt;
+        const QVector3D interpolated(
+            h00 * m_lastPosition.x() + h10 * m_lastVelocity.x() + h01 * position.x() + h11 * velocity.x(),
+            h00 * m_lastPosition.y() + h10 * m_lastVelocity.y() + h01 * position.y() + h11 * velocity.y(),
+            h00 * m_lastPosition.z() + h10 * m_lastVelocity.z() + h01 * position.z() + h11 * velocity.z());
+        record({ interpolated, m_lastTime + s * dt });
+    }
+    // Carry the leftover arc, so density does not depend on how the substeps fall
+    m_arcSinceRecord = std::max(0.0, m_arcSinceRecord - due * arcStep);
+
+    m_lastTime = time;
+    m_lastPosition = position;
+    m_lastVelocity = velocity;
+}
+
+const std::deque<TrailSampler::Point>& TrailSampler::getPoints() const
+{
+    static const std::deque<Point> none;
+    return m_points ? *m_points : none;
+}
+
+const std::deque<TrailSampler::Point>& TrailSampler::getSimplified(double tolerance) const
+{
+    int index = -1;
+    double levelTolerance = FINEST_TOLERANCE;
+    while (index + 1 < LEVEL_COUNT && levelTolerance <= tolerance) {
+        ++index;
+        levelTolerance *= LEVEL_RATIO;
+    }
+    if (index < 0 || !m_points) {
+        return getPoints();
+    }
+
+    auto found = m_levels.find(index);
+    if (found == m_levels.end()) {
+        found = m_levels.emplace(index, Level()).first;
+        found->second.tolerance = levelTolerance / LEVEL_RATIO;
+    }
+    Level& level = found->second;
+    const std::deque<Point>& recorded = *m_points;
+
+    // Feed the points recorded since this level was last read. If those have all been
+    // evicted in the meantime, the level starts over from the oldest recorded point.
+    if (!level.points.empty() && level.points.back().time >= recorded.front().time) {
+        auto next = std::upper_bound(recorded.begin(), recorded.end(), level.points.back().time,
+                                     [](double time, const Point& point) { return time < point.time; });
+        for (; next != recorded.end(); ++next) {
+            simplify(level, *next);
+        }
+        trimLevel(level, recorded);
+    } else {
+        restartLevel(level, recorded);
+    }
+    return level.points;
+}
+
+void TrailSampler::record(const Point& point)
+{
+    m_points->push_back(point);
+    if (m_points->size() > MAX_POINTS) {
+        m_points->pop_front();
+    }
+}
+
+void TrailSampler::simplify(Level& level, const Point& point)
+{
+    std::deque<Point>& kept = level.points;
+    if (kept.size() < 2) {
+        kept.push_back(point);
+        startCone(level, kept[0], point);
+        return;
+    }
+
+    // The newest kept point can be dropped if the segment from the last fixed point to the
+    // new point passes within tolerance of it and of everything dropped before it. That holds
+    // when the new point's direction is inside the cone and it reaches at least as far as
+    // they did; a shorter segment could stop up to a tolerance short of one of them.
+    const Point& anchor = kept[kept.size() - 2];
+    const double dx = double(point.position.x()) - anchor.position.x();
+    const double dy = double(point.position.y()) - anchor.position.y();
+    const double d = std::sqrt(dx * dx + dy * dy);
+
+    bool fits;
+    if (d <= level.tolerance) {
+        fits = level.reach <= level.tolerance;
+    } else {
+        const double ux = dx / d;
+        const double uy = dy / d;
+        fits = d >= level.reach &&
+               (level.coneOpen || (level.lowX * uy - level.lowY * ux >= 0.0 && ux * level.highY - uy * level.highX >= 0.0));
+        if (fits) {
+            narrowCone(level, ux, uy, d);
+        }
+    }
+
+    if (fits) {
+        level.reach = std::max(level.reach, d);
+        kept.back() = point;
+    } else {
+        kept.push_back(point);
+        startCone(level, kept[kept.size() - 2], point);
+    }
+}
+
+void TrailSampler::startCone(Level& level, const Point& anchor, const Point& point)
+{
+    const double dx = double(point.position.x()) - anchor.position.x();
+    const double dy = double(point.position.y()) - anchor.position.y();
+    const double d = std::sqrt(dx * dx + dy * dy);
+    level.coneOpen = true;
+    level.reach = d;
+    if (d > level.tolerance) {
+        narrowCone(level, dx / d, dy / d, d);
+    }
+}
+
+void TrailSampler::narrowCone(Level& level, double ux, double uy, double d)
+{
+    // Directions whose ray passes within tolerance of a point at distance d along (ux, uy)
+    const double s = level.tolerance / d;
+    const double c = std::sqrt(1.0 - s * s);
+    const double lowX = ux * c + uy * s, lowY = -ux * s + uy * c;
+    const double highX = ux * c - uy * s, highY = ux * s + uy * c;
+
+    if (level.coneOpen) {
+        level.lowX = lowX;
+        level.lowY = lowY;
+        level.highX = highX;
+        level.highY = highY;
+        level.coneOpen = false;
+        return;
+    }
+    // Intersect: keep the more counter-clockwise low edge and the more clockwise high edge
+    if (level.lowX * lowY - level.lowY * lowX > 0.0) {
+        level.lowX = lowX;
+        level.lowY = lowY;
+    }
+    if (highX * level.highY - highY * level.highX > 0.0) {
+        level.highX = highX;
+        level.highY = highY;
+    }
+}
+
+void TrailSampler::restartLevel(Level& level, const std::deque<Point>& recorded)
+{
+    level.points.assign(1, recorded.front());
+    level.coneOpen = true;
+    level.reach = 0.0;
+    for (auto next = recorded.begin() + 1; next != recorded.end(); ++next) {
+        simplify(level, *next);
+    }
+}
+
+void TrailSampler::trimLevel(Level& level, const std::deque<Point>& recorded)
+{
+    std::deque<Point>& kept = level.points;
+    const Point& oldest = recorded.front();
+    while (kept.size() > 2 && kept[1].time <= oldest.time) {
+        kept.pop_front();
+    }
+    if (kept[0].time >= oldest.time) {
+        return;
+    }
+
+    // A single segment is still being extended along a cone anchored at its start, so the
+    // start cannot move without breaking the tolerance. Simplify the recorded points again.
+    if (kept.size() == 2) {
+        restartLevel(level, recorded);
+        return;
+    }
+
+    // Cut the first segment so every level starts where the recorded trail does. The cut goes
+    // where the first of the recorded points it covers projects onto it, so each of them keeps
+    // its distance to the part that is left. (Cutting at the interpolated time could leave
+    // some of them behind the new start.)
+    const QVector3D start = kept[0].position;
+    const QVector3D end = kept[1].position;
+    const double dx = double(end.x()) - start.x();
+    const double dy = double(end.y()) - start.y();
+    const double lengthSq = dx * dx + dy * dy;
+    double s = 0.0;
+    if (lengthSq > 0.0) {
+        s = 1.0;
+        for (auto point = recorded.begin(); point != recorded.end() && point->time < kept[1].time; ++point) {
+            const double along = (double(point->position.x()) - start.x()) * dx + (double(point->position.y()) - start.y()) * dy;
+            s = std::min(s, along / lengthSq);
+        }
+        s = std::max(0.0, s);
+    }
+    kept[0].position = start + static_cast<float>(s) * (end - start);
+    kept[0].time = oldest.time;
+}
@@ -0,0 +1,88 @@
+#ifndef TRAILSAMPLER_H
+#define TRAILSAMPLER_H
+
+#include <QVector3D>
+#include <deque>
+#include <map>
+#include <optional>
+
+// Orbital trail of one body, sampled in simulated time rather than once per GUI frame.
+//
+// The integrator feeds the sampler every substep. A point is recorded once the body has
+// moved through ANGULAR_STEP of arc (measured from the origin) or after MAX_INTERVAL of
+// simulated time, whichever comes first. When a substep spans several points, they are
+// interpolated along a cubic Hermite curve through its end states. So trail density no
+// longer depends on the time scale or the frame rate.
+//
+// Simplified copies, one per zoom level, keep only the points needed to follow the trail
+// within that level's tolerance. A level is created the first time it is asked for, and
+// brought up to date with the points recorded since each time it is read, in constant
+// time per point. So recording stays cheap, and points that are evicted before they are
+// drawn are never simplified. Simplification works in the x-y plane that
+// SolarSystemWidget draws.
+class TrailSampler
+{
+public:
+    struct Point
+    {
+        QVector3D position;
+        double time;
+    };
+
+    static const int LEVEL_COUNT = 10;
+    static constexpr double FINEST_TOLERANCE = 5e5; // Meters; each level is LEVEL_RATIO times coarser
+    static constexpr double LEVEL_RATIO = 4.0;
+    static constexpr double ANGULAR_STEP = 3.14159265358979323846 / 180.0; // Radians of arc per point
+    static constexpr double MIN_ARC_LENGTH = 1e6;            // Meters
+    static constexpr double MAX_INTERVAL = 30.0 * 24 * 3600; // Seconds
+    static const size_t MAX_POINTS = 2000;
+
+    TrailSampler();
+
+    // A disabled trail records nothing and holds no point storage
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_points.has_value(); }
+
+    // Starts a new trail at this state
+    void reset(double time, const QVector3D& position, const QVector3D& velocity);
+    // State at the end of an integrator substep
+    void feed(double time, const QVector3D& position, const QVector3D& velocity);
+
+    // Every recorded point, oldest first; empty while disabled
+    const std::deque<Point>& getPoints() const;
+    // The coarsest simplified copy that stays within `tolerance` meters of the recorded points
+    const std::deque<Point>& getSimplified(double tolerance) const;
+
+private:
+    struct Level
+    {
+        double tolerance;
+        std::deque<Point> points; // Kept points; the last one is the newest point simplified
+
+        // Directions from the last fixed point (the second-to-last kept point) along which a
+        // segment still passes within tolerance of every point after it, as unit vectors
+        // from the low edge counter-clockwise to the high edge. Open means unconstrained.
+        bool coneOpen;
+        double lowX, lowY, highX, highY;
+        double reach; // Farthest distance of those points from the fixed point
+    };
+
+    void record(const Point& point);
+    static void simplify(Level& level, const Point& point);
+    static void startCone(Level& level, const Point& anchor, const Point& point);
+    static void narrowCone(Level& level, double ux, double uy, double d);
+    static void restartLevel(Level& level, const std::deque<Point>& recorded);
+    static void trimLevel(Level& level, const std::deque<Point>& recorded);
+
+    std::optional<std::deque<Point>> m_points;
+    // Simplified copies by level index, a cache filled in by getSimplified()
+    mutable std::map<int, Level> m_levels;
+
+    // State at the last feed(), for interpolating within the next substep
+    double m_lastTime;
+    QVector3D m_lastPosition;
+    QVector3D m_lastVelocity;
+    double m_arcSinceRecord;
+};
+
+#endif // TRAILSAMPLER_H
@@ -0,0 +1,216 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+namespace {
+
+const std::chrono::steady_clock::time_point s_epoch = std::chrono::steady_clock::now();
+
+struct BufferRegistry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ProfileThreadBuffer>> buffers;
+};
+
+BufferRegistry& registry()
+{
+    static BufferRegistry instance;
+    return instance;
+}
+
+// Hands the buffer back to the registry when its thread exits
+struct ThreadBufferHandle
+{
+    ProfileThreadBuffer* buffer = nullptr;
+    ~ThreadBufferHandle();
+};
+
+double percentile(const std::vector<std::int64_t>& sortedNs, double p)
+{
+    // Nearest-rank percentile
+    size_t rank = static_cast<size_t>(std::ceil(p * sortedNs.size()));
+    rank = std::min(sortedNs.size(), std::max<size_t>(1, rank));
+    return sortedNs[rank - 1] / 1.0e6;
+}
+
+void writeJsonString(std::ofstream& out, const char* text)
+{
+    out << '"';
+    for (const char* c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\';
+        }
+        out << *c;
+    }
+    out << '"';
+}
+
+} // namespace
+
+std::atomic<bool> Profiler::s_enabled(true);
+
+ProfileThreadBuffer::ProfileThreadBuffer(std::uint32_t threadId)
+    : m_threadId(threadId),
+      m_inUse(true)
+{
+    for (Ring& ring : m_rings) {
+        ring.events.resize(CAPACITY);
+        ring.writeIndex.store(0, std::memory_order_relaxed);
+    }
+}
+
+void ProfileThreadBuffer::snapshot(std::vector<ProfileEvent>& out) const
+{
+    for (const Ring& ring : m_rings) {
+        snapshot(ring, out);
+    }
+}
+
+void ProfileThreadBuffer::snapshot(const Ring& ring, std::vector<ProfileEvent>& out)
+{
+    const std::uint64_t end = ring.writeIndex.load(std::memory_order_acquire);
+    const std::uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+
+    const size_t firstOut = out.size();
+    for (std::uint64_t i = begin; i < end; ++i) {
+        out.push_back(ring.events[i & (CAPACITY - 1)]);
+    }
+
+    // Anything at or below (current write index - CAPACITY) may have been
+    // overwritten while we were copying, so drop it from the snapshot.
+    const std::uint64_t after = ring.writeIndex.load(std::memory_order_acquire);
+    const std::uint64_t safeBegin = after >= CAPACITY ? after - CAPACITY + 1 : 0;
+    if (safeBegin > begin) {
+        const size_t torn = static_cast<size_t>(std::min(safeBegin, end) - begin);
+        out.erase(out.begin() + firstOut, out.begin() + firstOut + torn);
+    }
+}
+
+bool ProfileThreadBuffer::tryAcquire()
+{
+    bool expected = false;
+    return m_inUse.compare_exchange_strong(expected, true, std::memory_order_acquire);
+}
+
+void ProfileThreadBuffer::release()
+{
+    m_inUse.store(false, std::memory_order_release);
+}
+
+ThreadBufferHandle::~ThreadBufferHandle()
+{
+    if (buffer) {
+        buffer->release();
+    }
+}
+
+std::int64_t Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - s_epoch).count();
+}
+
+ProfileThreadBuffer& Profiler::threadBuffer()
+{
+    thread_local ThreadBufferHandle handle;
+    if (handle.buffer) {
+        return *handle.buffer;
+    }
+
+    BufferRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    // Reuse the buffer of a thread that has exited before allocating a new one
+    for (auto& buffer : reg.buffers) {
+        if (buffer->tryAcquire()) {
+            handle.buffer = buffer.get();
+            return *handle.buffer;
+        }
+    }
+
+    reg.buffers.push_back(std::make_unique<ProfileThreadBuffer>(
+        static_cast<std::uint32_t>(reg.buffers.size() + 1)));
+    handle.buffer = reg.buffers.back().get();
+    return *handle.buffer;
+}
+
+void Profiler::record(const char* name, std::int64_t startNs, std::int64_t durationNs, ProfileRing ring)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    threadBuffer().record(ring, name, startNs, durationNs);
+}
+
+void Profiler::collect(std::vector<ProfileEvent>& events, std::vector<std::uint32_t>& threadIds)
+{
+    BufferRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& buffer : reg.buffers) {
+        buffer->snapshot(events);
+        threadIds.resize(events.size(), buffer->threadId());
+    }
+}
+
+std::vector<ProfileZoneStats> Profiler::zoneStatistics(double windowMs)
+{
+    std::vector<ProfileEvent> events;
+    std::vector<std::uint32_t> threadIds;
+    collect(events, threadIds);
+
+    const std::int64_t windowStart = now() - static_cast<std::int64_t>(windowMs * 1.0e6);
+    std::map<std::string_view, std::vector<std::int64_t>> durationsByZone;
+    for (const auto& event : events) {
+        if (event.startNs >= windowStart) {
+            durationsByZone[event.name].push_back(event.durationNs);
+        }
+    }
+
+    std::vector<ProfileZoneStats> stats;
+    stats.reserve(durationsByZone.size());
+    for (auto& [name, durations] : durationsByZone) {
+        std::sort(durations.begin(), durations.end());
+        stats.push_back(ProfileZoneStats{
+            std::string(name),
+            durations.size(),
+            percentile(durations, 0.50),
+            percentile(durations, 0.95),
+            percentile(durations, 0.99),
+            durations.back() / 1.0e6
+        });
+    }
+    return stats;
+}
+
+bool Profiler::writeChromeTrace(const std::string& path)
+{
+    std::vector<ProfileEvent> events;
+    std::vector<std::uint32_t> threadIds;
+    collect(events, threadIds);
+
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+
+    // Trace-event timestamps are in microseconds
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    for (size_t i = 0; i < events.size(); ++i) {
+        out << "{\"name\":";
+        writeJsonString(out, events[i].name);
+        out << ",\"cat\":\"ss_sim\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadIds[i]
+            << ",\"ts\":" << events[i].startNs / 1.0e3
+            << ",\"dur\":" << events[i].durationNs / 1.0e3 << "}";
+        out << (i + 1 < events.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,135 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A single timed zone as recorded by one thread
+struct ProfileEvent
+{
+    const char* name;        // Must point at a string literal (never copied)
+    std::int64_t startNs;    // Nanoseconds since the profiler epoch
+    std::int64_t durationNs;
+};
+
+// Summary of one zone over the statistics window, used by the overlay
+struct ProfileZoneStats
+{
+    std::string name;
+    size_t count;
+    double p50Ms;
+    double p95Ms;
+    double p99Ms;
+    double maxMs;
+};
+
+// Which ring of its thread's buffer a zone is recorded in. Zones that can repeat thousands
+// of times per frame (per substep, per solver phase) go to the fine ring, so a burst of them
+// cannot overwrite the frame-level zones the overlay and trace dump are read for.
+enum class ProfileRing { Coarse, Fine };
+
+// Fixed-size rings of events owned by exactly one writer thread.
+// The writer never blocks; readers copy a snapshot and discard any slot the
+// writer may have overwritten while they were copying.
+class ProfileThreadBuffer
+{
+public:
+    static const size_t CAPACITY = 1 << 14; // Events per ring; must be a power of two
+
+    explicit ProfileThreadBuffer(std::uint32_t threadId);
+
+    void record(ProfileRing ring, const char* name, std::int64_t startNs, std::int64_t durationNs)
+    {
+        Ring& target = m_rings[static_cast<int>(ring)];
+        const std::uint64_t index = target.writeIndex.load(std::memory_order_relaxed);
+        target.events[index & (CAPACITY - 1)] = ProfileEvent{ name, startNs, durationNs };
+        target.writeIndex.store(index + 1, std::memory_order_release);
+    }
+
+    void snapshot(std::vector<ProfileEvent>& out) const;
+    std::uint32_t threadId() const { return m_threadId; }
+
+    // Ownership handoff between threads (buffers outlive the threads that wrote them)
+    bool tryAcquire();
+    void release();
+
+private:
+    struct Ring
+    {
+        std::vector<ProfileEvent> events;
+        std::atomic<std::uint64_t> writeIndex;
+    };
+
+    static void snapshot(const Ring& ring, std::vector<ProfileEvent>& out);
+
+    Ring m_rings[2]; // Indexed by ProfileRing
+    std::uint32_t m_threadId;
+    std::atomic<bool> m_inUse; // Released when the owning thread exits, so pool threads can reuse it
+};
+
+// Process-wide, always-on zone recorder.
+// Each thread writes to its own ProfileThreadBuffer; only the first zone on a
+// new thread takes a lock (to register the buffer).
+class Profiler
+{
+public:
+    static void setEnabled(bool enabled) { s_enabled.store(enabled, std::memory_order_relaxed); }
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Monotonic nanoseconds since the profiler epoch (first use)
+    static std::int64_t now();
+
+    // Record a zone measured by hand, e.g. the interval between two frames. Does nothing while disabled.
+    static void record(const char* name, std::int64_t startNs, std::int64_t durationNs,
+                       ProfileRing ring = ProfileRing::Coarse);
+
+    // Percentiles per zone over the last windowMs of recorded events, sorted by name
+    static std::vector<ProfileZoneStats> zoneStatistics(double windowMs = 2000.0);
+
+    // Write every event still held in the thread buffers as Chrome trace-event JSON
+    // (load in chrome://tracing or ui.perfetto.dev). Returns false if the file cannot be written.
+    static bool writeChromeTrace(const std::string& path);
+
+private:
+    static ProfileThreadBuffer& threadBuffer();
+    static void collect(std::vector<ProfileEvent>& events, std::vector<std::uint32_t>& threadIds);
+
+    static std::atomic<bool> s_enabled;
+};
+
+// RAII zone: measures the enclosing scope and records it on destruction
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name, ProfileRing ring = ProfileRing::Coarse)
+        : m_name(Profiler::isEnabled() ? name : nullptr),
+          m_ring(ring),
+          m_startNs(m_name ? Profiler::now() : 0)
+    {
+    }
+
+    ~ProfileScope()
+    {
+        if (m_name) {
+            Profiler::record(m_name, m_startNs, Profiler::now() - m_startNs, m_ring);
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* m_name;
+    ProfileRing m_ring;
+    std::int64_t m_startNs;
+};
+
+#define PROFILE_SCOPE_CONCAT_INNER(a, b) a##b
+#define PROFILE_SCOPE_CONCAT(a, b) PROFILE_SCOPE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_SCOPE_CONCAT(profileScope_, __LINE__)(name)
+// For zones that repeat many times per frame, such as once per physics substep
+#define PROFILE_FINE_SCOPE(name) ProfileScope PROFILE_SCOPE_CONCAT(profileScope_, __LINE__)(name, ProfileRing::Fine)
+
+#endif // PROFILER_H
@@ -0,0 +1,340 @@
+#include "RemoteControlServer.h"
+#include "../physics/NBodySimulation.h"
+#include "../profiling/Profiler.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QtGlobal>
+#include <algorithm>
+#include <cstring>
+
+// Wire values are written in host order, so vectors can be copied straight out of the bodies
+static_assert(Q_BYTE_ORDER == Q_LITTLE_ENDIAN, "the remote protocol is little-endian");
+static_assert(sizeof(QVector3D) == 3 * sizeof(float), "QVector3D must be three packed floats");
+
+namespace {
+
+// Bytes before the index array: time, sequence, fields, reserved, count, total bodies
+const int STATE_FRAME_PREFIX = sizeof(double) + sizeof(quint32) + 2 * sizeof(quint16) + 2 * sizeof(quint32);
+static_assert(STATE_FRAME_PREFIX == 24, "StateFrame prefix no longer matches the documented layout");
+
+template <typename T>
+void put(char*& out, T value)
+{
+    std::memcpy(out, &value, sizeof value);
+    out += sizeof value;
+}
+
+template <typename T>
+void append(QByteArray& bytes, T value)
+{
+    bytes.append(reinterpret_cast<const char*>(&value), sizeof value);
+}
+
+} // namespace
+
+RemoteControlServer::RemoteControlServer(NBodySimulation* simulation, QObject* parent)
+    : QObject(parent),
+      m_simulation(simulation),
+      m_server(new QLocalServer(this)),
+      m_sequence(0)
+{
+    // Only the user running the simulator may control it
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_server, &QLocalServer::newConnection, this, &RemoteControlServer::acceptConnections);
+    connect(m_simulation, &NBodySimulation::simulationStepCompleted, this, &RemoteControlServer::publishState);
+}
+
+RemoteControlServer::~RemoteControlServer()
+{
+    m_server->close();
+}
+
+bool RemoteControlServer::listen(const QString& name)
+{
+    // A socket that accepts a connection belongs to a running instance and is left alone.
+    // One that refuses is stale, left by a crashed run, and can be replaced.
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(PROBE_TIMEOUT_MS)) {
+        probe.abort();
+        m_listenError = QString("another instance is already listening on %1").arg(name);
+        return false;
+    }
+
+    QLocalServer::removeServer(name);
+    if (!m_server->listen(name)) {
+        m_listenError = m_server->errorString();
+        return false;
+    }
+    m_listenError.clear();
+    return true;
+}
+
+QString RemoteControlServer::fullServerName() const
+{
+    return m_server->fullServerName();
+}
+
+QString RemoteControlServer::errorString() const
+{
+    return m_listenError;
+}
+
+void RemoteControlServer::acceptConnections()
+{
+    while (QLocalSocket* socket = m_server->nextPendingConnection()) {
+        auto client = std::make_unique<Client>();
+        client->socket = socket;
+        client->subscribed = false;
+        client->fields = Position | Velocity;
+        client->minimumInterval = 0;
+        client->skippedFrames = 0;
+
+        Client* connected = client.get();
+        connect(socket, &QLocalSocket::readyRead, this, [this, connected]() { readCommands(*connected); });
+        // Queued, because a failed write can report the disconnect while a command is being handled
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() { removeClient(socket); }, Qt::QueuedConnection);
+        m_clients.push_back(std::move(client));
+    }
+}
+
+void RemoteControlServer::removeClient(QLocalSocket* socket)
+{
+    auto found = std::find_if(m_clients.begin(), m_clients.end(),
+                              [socket](const std::unique_ptr<Client>& client) { return client->socket == socket; });
+    if (found == m_clients.end()) {
+        return;
+    }
+    m_clients.erase(found);
+    socket->disconnect(this);
+    socket->deleteLater();
+}
+
+void RemoteControlServer::readCommands(Client& client)
+{
+    client.pendingCommand.append(client.socket->readAll());
+
+    int newline;
+    while ((newline = client.pendingCommand.indexOf('\n')) >= 0) {
+        const QString line = QString::fromUtf8(client.pendingCommand.left(newline)).trimmed();
+        client.pendingCommand.remove(0, newline + 1);
+        if (!line.isEmpty()) {
+            handleCommand(client, line);
+        }
+    }
+
+    if (client.pendingCommand.size() > MAX_COMMAND_LENGTH) {
+        client.pendingCommand.clear();
+        sendReply(client, "error: command too long");
+    }
+}
+
+void RemoteControlServer::handleCommand(Client& client, const QString& line)
+{
+    const QString command = line.section(' ', 0, 0).toLower();
+    const QString arguments = line.section(' ', 1).trimmed();
+
+    if (command == "play") {
+        emit playRequested();
+        sendReply(client, "ok");
+    } else if (command == "pause") {
+        emit pauseRequested();
+        sendReply(client, "ok");
+    } else if (command == "timescale") {
+        bool ok = false;
+        const int scalePercentage = arguments.toInt(&ok);
+        if (!ok || scalePercentage < 0 || scalePercentage > 100) {
+            sendReply(client, "error: timescale takes a slider position from 0 to 100");
+            return;
+        }
+        emit timeScaleRequested(scalePercentage);
+        sendReply(client, "ok");
+    } else if (command == "bodies") {
+        sendBodyList(client);
+    } else if (command == "subscribe") {
+        const QString error = subscribe(client, arguments);
+        sendReply(client, error.isEmpty() ? QString("ok") : error);
+    } else if (command == "unsubscribe") {
+        client.subscribed = false;
+        sendReply(client, QString("ok: %1 frames skipped while the client was behind").arg(client.skippedFrames));
+        client.skippedFrames = 0;
+    } else {
+        sendReply(client, QString("error: unknown command %1").arg(command));
+    }
+}
+
+QString RemoteControlServer::subscribe(Client& client, const QString& arguments)
+{
+    const std::vector<CelestialBody>& all = m_simulation->getBodies();
+    quint16 fields = Position | Velocity;
+    double rate = 0.0;
+    std::vector<quint32> bodies;
+
+    // Options are separated by spaces, except bodies=, which takes the rest of the line
+    // because body names may contain spaces
+    QString remaining = arguments;
+    while (!remaining.isEmpty()) {
+        QString option;
+        if (remaining.startsWith("bodies=")) {
+            option = remaining;
+            remaining.clear();
+        } else {
+            option = remaining.section(' ', 0, 0);
+            remaining = remaining.section(' ', 1).trimmed();
+        }
+        const QString key = option.section('=', 0, 0);
+        const QString value = option.section('=', 1);
+
+        if (key == "rate") {
+            bool ok = false;
+            rate = value.toDouble(&ok);
+            if (!ok || rate < 0.0) {
+                return "error: rate must be a non-negative number of frames per second";
+            }
+        } else if (key == "fields") {
+            if (value == "position") {
+                fields = Position;
+            } else if (value == "velocity") {
+                fields = Velocity;
+            } else if (value == "state") {
+                fields = Position | Velocity;
+            } else {
+                return "error: fields must be position, velocity or state";
+            }
+        } else if (key == "bodies") {
+            for (const QString& entry : value.split(',')) {
+                const QString name = entry.trimmed();
+                if (name.isEmpty()) {
+                    continue;
+                }
+                bool isIndex = false;
+                const uint index = name.toUInt(&isIndex);
+                if (isIndex && index < all.size()) {
+                    bodies.push_back(index);
+                    continue;
+                }
+                auto match = std::find_if(all.begin(), all.end(),
+                                          [&name](const CelestialBody& body) { return body.getName() == name; });
+                if (match == all.end()) {
+                    return QString("error: unknown body %1").arg(name);
+                }
+                bodies.push_back(static_cast<quint32>(match - all.begin()));
+            }
+        } else {
+            return QString("error: unknown option %1").arg(key);
+        }
+    }
+
+    client.subscribed = true;
+    client.fields = fields;
+    client.bodies = std::move(bodies);
+    client.minimumInterval = rate > 0.0 ? static_cast<qint64>(1e9 / rate) : 0;
+    client.sinceLastFrame.invalidate(); // The first frame goes out after the next step
+    return QString();
+}
+
+void RemoteControlServer::publishState()
+{
+    ++m_sequence;
+    if (m_clients.empty()) {
+        return;
+    }
+    PROFILE_SCOPE("RemoteControlServer::publishState");
+
+    for (const auto& client : m_clients) {
+        if (!client->subscribed) {
+            continue;
+        }
+        if (client->sinceLastFrame.isValid() && client->sinceLastFrame.nsecsElapsed() < client->minimumInterval) {
+            continue;
+        }
+        // A client that stops reading would otherwise grow the write buffer without bound
+        if (client->socket->bytesToWrite() > MAX_PENDING_BYTES) {
+            ++client->skippedFrames;
+            continue;
+        }
+        send(*client, StateFrame, stateFrame(client->fields, client->bodies));
+        client->sinceLastFrame.start();
+    }
+    m_frameCache.clear();
+}
+
+const QByteArray& RemoteControlServer::stateFrame(quint16 fields, const std::vector<quint32>& bodies)
+{
+    auto key = std::make_pair(fields, bodies);
+    auto cached = m_frameCache.find(key);
+    if (cached != m_frameCache.end()) {
+        return cached->second;
+    }
+
+    const std::vector<CelestialBody>& all = m_simulation->getBodies();
+    const quint32 count = static_cast<quint32>(bodies.empty() ? all.size() : bodies.size());
+    const int vectorCount = ((fields & Position) ? 1 : 0) + ((fields & Velocity) ? 1 : 0);
+    auto indexAt = [&bodies](quint32 k) { return bodies.empty() ? k : bodies[k]; };
+
+    QByteArray payload(STATE_FRAME_PREFIX + count * sizeof(quint32) + vectorCount * count * sizeof(QVector3D),
+                       Qt::Uninitialized);
+    char* out = payload.data();
+    put(out, m_simulation->getSimulationTime());
+    put(out, m_sequence);
+    put(out, fields);
+    put(out, quint16(0));
+    put(out, count);
+    put(out, static_cast<quint32>(all.size()));
+    for (quint32 k = 0; k < count; ++k) {
+        put(out, indexAt(k));
+    }
+    if (fields & Position) {
+        for (quint32 k = 0; k < count; ++k) {
+            put(out, all[indexAt(k)].getPosition());
+        }
+    }
+    if (fields & Velocity) {
+        for (quint32 k = 0; k < count; ++k) {
+            put(out, all[indexAt(k)].getVelocity());
+        }
+    }
+    Q_ASSERT(out == payload.constData() + payload.size()); // Every byte written, none left uninitialised
+
+    return m_frameCache.emplace(std::move(key), std::move(payload)).first->second;
+}
+
+void RemoteControlServer::sendReply(Client& client, const QString& text)
+{
+    send(client, Reply, text.toUtf8());
+}
+
+void RemoteControlServer::sendBodyList(Client& client)
+{
+    const std::vector<CelestialBody>& all = m_simulation->getBodies();
+    QByteArray payload;
+    append(payload, static_cast<quint32>(all.size()));
+    for (size_t i = 0; i < all.size(); ++i) {
+        const CelestialBody& body = all[i];
+        const QColor color = body.getColor();
+        const QByteArray name = body.getName().toUtf8();
+        append(payload, static_cast<quint32>(i));
+        append(payload, body.getMass());
+        append(payload, body.getRadius());
+        append(payload, static_cast<quint8>(color.red()));
+        append(payload, static_cast<quint8>(color.green()));
+        append(payload, static_cast<quint8>(color.blue()));
+        append(payload, static_cast<quint8>(color.alpha()));
+        append(payload, static_cast<quint16>(name.size()));
+        payload.append(name);
+    }
+    send(client, BodyList, payload);
+}
+
+void RemoteControlServer::send(Client& client, quint16 type, const QByteArray& payload)
+{
+    char header[HEADER_SIZE];
+    char* out = header;
+    put(out, MAGIC);
+    put(out, type);
+    put(out, quint16(0));
+    put(out, static_cast<quint32>(payload.size()));
+
+    client.socket->write(header, HEADER_SIZE);
+    client.socket->write(payload);
+}
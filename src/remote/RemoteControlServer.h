@@ -0,0 +1,103 @@
+#ifndef REMOTECONTROLSERVER_H
+#define REMOTECONTROLSERVER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class NBodySimulation;
+class QLocalServer;
+class QLocalSocket;
+
+// Local IPC endpoint for dashboards and scripts. Clients connect to a QLocalServer (a Unix
+// socket in the temp directory, or a named pipe on Windows) and send newline-terminated
+// text commands:
+//
+//   play | pause | timescale <0-100> | bodies | unsubscribe
+//   subscribe [rate=<hz>] [fields=position|velocity|state] [bodies=<name or index>,...]
+//
+// Every command is answered with a Reply, except bodies, which is answered with a BodyList.
+//
+// Everything the server sends is a binary message: a 12-byte header (magic, type, reserved,
+// payload length) followed by the payload, all little-endian. A subscribed client gets a
+// StateFrame after each simulation step, at most `rate` per second. A frame's arrays are
+// column-wise (all indices, then all positions, then all velocities) as float32 triples,
+// the same layout CelestialBody stores them in. So the server copies each vector straight
+// into the frame, and a client can map the arrays in place (e.g. numpy.frombuffer).
+// Clients with the same subscription share one encoded frame per step.
+class RemoteControlServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum MessageType : quint16 {
+        Reply = 1,     // UTF-8 text: "ok" or "error: ..."
+        BodyList = 2,  // u32 count, then per body: u32 index, f64 mass, f64 radius, u8 rgba[4], u16 name length, UTF-8 name
+        StateFrame = 3 // f64 time, u32 sequence, u16 fields, u16 reserved, u32 count, u32 total bodies,
+                       // u32 index[count], f32 position[count][3] (if subscribed), f32 velocity[count][3] (if subscribed)
+    };
+    enum Field : quint16 { Position = 1, Velocity = 2 };
+
+    static const quint32 MAGIC = 0x4d495353;                 // "SSIM" on the wire
+    static const int HEADER_SIZE = 12;
+    static const int MAX_COMMAND_LENGTH = 64 * 1024;
+    static const qint64 MAX_PENDING_BYTES = 4 * 1024 * 1024; // A client this far behind skips frames
+    static const int PROBE_TIMEOUT_MS = 1000;                // For a running instance to accept a connection
+
+    explicit RemoteControlServer(NBodySimulation* simulation, QObject* parent = nullptr);
+    ~RemoteControlServer() override;
+
+    // `name` is a QLocalServer name. A stale socket left by a crashed run is removed first,
+    // but if another instance still answers on it, listen() fails.
+    bool listen(const QString& name);
+    QString fullServerName() const;
+    QString errorString() const; // Why the last listen() failed
+
+signals:
+    // Control commands; main.cpp routes them to the same slots as the buttons and slider
+    void playRequested();
+    void pauseRequested();
+    void timeScaleRequested(int scalePercentage);
+
+private slots:
+    void acceptConnections();
+    void publishState();
+
+private:
+    struct Client
+    {
+        QLocalSocket* socket;
+        QByteArray pendingCommand;   // Bytes received after the last newline
+        bool subscribed;
+        quint16 fields;
+        std::vector<quint32> bodies; // Subscribed body indices, in request order; empty means all
+        qint64 minimumInterval;      // Nanoseconds between frames; 0 sends every step
+        QElapsedTimer sinceLastFrame;
+        quint64 skippedFrames;       // Frames withheld because the client was not reading
+    };
+
+    void readCommands(Client& client);
+    void handleCommand(Client& client, const QString& line);
+    QString subscribe(Client& client, const QString& arguments); // Returns an error, or empty
+    void sendReply(Client& client, const QString& text);
+    void sendBodyList(Client& client);
+    void send(Client& client, quint16 type, const QByteArray& payload);
+    const QByteArray& stateFrame(quint16 fields, const std::vector<quint32>& bodies);
+    void removeClient(QLocalSocket* socket);
+
+    NBodySimulation* m_simulation;
+    QLocalServer* m_server;
+    std::vector<std::unique_ptr<Client>> m_clients;
+    quint32 m_sequence; // Steps completed since the server was created
+    QString m_listenError;
+
+    // Frame payloads encoded during the current publishState(), keyed by subscription
+    std::map<std::pair<quint16, std::vector<quint32>>, QByteArray> m_frameCache;
+};
+
+#endif // REMOTECONTROLSERVER_H
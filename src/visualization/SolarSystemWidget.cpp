@@ -3,19 +3,28 @@
 #include <QPaintEvent>
 #include <QWheelEvent>
 #include <QMouseEvent>
+#include <QKeyEvent>
 #include <QTimer>
 #include <QColor>
+#include <QFontMetrics>
+#include <QStringList>
+#include <QDebug>
 #include <cmath>
+#include "../profiling/Profiler.h"
 
 SolarSystemWidget::SolarSystemWidget(NBodySimulation* simulation, QWidget* parent)
     : QWidget(parent), 
       m_simulation(simulation),
       m_scale(1e10), // Initial scale: 1 pixel = 1e10 meters
       m_viewOffset(0, 0),
-      m_selectedBodyIndex(-1) // Initialize with no body selected
+      m_selectedBodyIndex(-1), // Initialize with no body selected
+      m_showProfilerOverlay(false),
+      m_lastFrameStartNs(-1)
 {
     // Connect the simulation's signal to this widget's update slot
     connect(m_simulation, &NBodySimulation::simulationStepCompleted, this, &SolarSystemWidget::updateView);
+    // The interval across a pause is not a frame, so frame timing starts over
+    connect(m_simulation, &NBodySimulation::runningChanged, this, [this]() { m_lastFrameStartNs = -1; });
     
     // Set a strong focus policy to receive keyboard events if needed later
     setFocusPolicy(Qt::StrongFocus);
@@ -23,6 +32,18 @@ SolarSystemWidget::SolarSystemWidget(NBodySimulation* simulation, QWidget* paren
 
 void SolarSystemWidget::paintEvent(QPaintEvent* event)
 {
+    // Frame time is measured paint-to-paint, so it includes physics and event handling.
+    // Paints while paused (panning, zooming) are not counted.
+    if (m_simulation->isRunning()) {
+        const std::int64_t frameStartNs = Profiler::now();
+        if (m_lastFrameStartNs >= 0) {
+            Profiler::record("frame", m_lastFrameStartNs, frameStartNs - m_lastFrameStartNs);
+        }
+        m_lastFrameStartNs = frameStartNs;
+    }
+
+    PROFILE_SCOPE("SolarSystemWidget::paintEvent");
+
     QPainter painter(this);
     painter.setRenderHint(QPainter::Antialiasing);
     
@@ -33,58 +54,74 @@ void SolarSystemWidget::paintEvent(QPaintEvent* event)
     const QPointF viewCenter(width() / 2.0 + m_viewOffset.x(), height() / 2.0 + m_viewOffset.y());
 
     auto& bodies = m_simulation->getBodies();
-    for (const auto& body : bodies) {
-        // --- Draw Orbital Trails ---
-        const auto& history = body.getPositionHistory();
-        if (history.size() > 1) {
-            for (size_t i = 0; i < history.size() - 1; ++i) {
+
+    // --- Draw Orbital Trails ---
+    // All trails are drawn first so no trail is painted over a body
+    {
+        PROFILE_SCOPE("paint.trails");
+        for (const auto& body : bodies) {
+            // Simplified to half a pixel: finer detail is invisible at this zoom
+            const auto& trail = body.getTrail().getSimplified(0.5 * m_scale);
+            if (trail.empty()) continue;
+
+            // Fade and taper by age, from the oldest point to the body itself
+            const double oldestTime = trail.front().time;
+            const double span = trail.back().time - oldestTime;
+            for (size_t i = 0; i < trail.size(); ++i) {
+                const QVector3D& from = trail[i].position;
+                const QVector3D to = i + 1 < trail.size() ? trail[i + 1].position : body.getPosition();
                 QPointF p1(
-                    viewCenter.x() + history[i].x() / m_scale,
-                    viewCenter.y() + history[i].y() / m_scale
+                    viewCenter.x() + from.x() / m_scale,
+                    viewCenter.y() + from.y() / m_scale
                 );
                 QPointF p2(
-                    viewCenter.x() + history[i+1].x() / m_scale,
-                    viewCenter.y() + history[i+1].y() / m_scale
+                    viewCenter.x() + to.x() / m_scale,
+                    viewCenter.y() + to.y() / m_scale
                 );
 
                 // Calculate alpha for a fading effect (trail is dimmer at the start)
-                int alpha = static_cast<int>(200.0 * (static_cast<double>(i) / history.size()));
+                const double recency = span > 0.0 ? (trail[i].time - oldestTime) / span : 1.0;
+                int alpha = static_cast<int>(200.0 * recency);
                 QColor trailColor = body.getColor();
                 trailColor.setAlpha(alpha);
-                
+
                 // Calculate width for a tapering effect (thicker at the body)
-                double width = 1.5 * (static_cast<double>(i) / history.size());
+                double width = 1.5 * recency;
                 painter.setPen(QPen(trailColor, width));
                 painter.drawLine(p1, p2);
             }
         }
+    }
 
+    // --- Draw the Celestial Bodies ---
+    {
+        PROFILE_SCOPE("paint.bodies");
+        for (const auto& body : bodies) {
+            QPointF screenPos(
+                viewCenter.x() + body.getPosition().x() / m_scale,
+                viewCenter.y() + body.getPosition().y() / m_scale
+            );
 
-        // --- Draw the Celestial Body ---
-        QPointF screenPos(
-            viewCenter.x() + body.getPosition().x() / m_scale,
-            viewCenter.y() + body.getPosition().y() / m_scale
-        );
-
-        double radiusInKm = body.getRadius() / 1000.0;
-        double screenRadius;
+            double radiusInKm = body.getRadius() / 1000.0;
+            double screenRadius;
 
-        if (body.getName() == "Sol") {
-            screenRadius = 2.5 * std::log10(radiusInKm);
-            screenRadius = std::max(10.0, screenRadius);
-        } else {
-            screenRadius = 1.5 * std::log10(radiusInKm);
-            screenRadius = std::max(2.0, screenRadius);
-        }
+            if (body.getName() == "Sol") {
+                screenRadius = 2.5 * std::log10(radiusInKm);
+                screenRadius = std::max(10.0, screenRadius);
+            } else {
+                screenRadius = 1.5 * std::log10(radiusInKm);
+                screenRadius = std::max(2.0, screenRadius);
+            }
         
-        painter.setBrush(body.getColor());
-        painter.setPen(Qt::NoPen);
-        painter.drawEllipse(screenPos, screenRadius, screenRadius);
+            painter.setBrush(body.getColor());
+            painter.setPen(Qt::NoPen);
+            painter.drawEllipse(screenPos, screenRadius, screenRadius);
 
-        if (m_scale < 5e9) {
-            painter.setPen(Qt::white);
-            QPointF textPos(screenPos.x() + screenRadius + 5, screenPos.y());
-            painter.drawText(textPos, body.getName());
+            if (m_scale < 5e9) {
+                painter.setPen(Qt::white);
+                QPointF textPos(screenPos.x() + screenRadius + 5, screenPos.y());
+                painter.drawText(textPos, body.getName());
+            }
         }
     }
 
@@ -138,6 +175,51 @@ void SolarSystemWidget::paintEvent(QPaintEvent* event)
         painter.setPen(Qt::white);
         painter.drawText(textRect, Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap, infoText);
     }
+
+    if (m_showProfilerOverlay) {
+        drawProfilerOverlay(painter);
+    }
+}
+
+void SolarSystemWidget::drawProfilerOverlay(QPainter& painter)
+{
+    const auto stats = Profiler::zoneStatistics();
+
+    QFont font("Monospace");
+    font.setStyleHint(QFont::Monospace);
+    font.setPointSize(9);
+    painter.setFont(font);
+    const QFontMetrics metrics(font);
+
+    QStringList lines;
+    lines << QString("%1 %2 %3 %4 %5 %6")
+                 .arg("zone (last 2 s, ms)", -30)
+                 .arg("p50", 8).arg("p95", 8).arg("p99", 8).arg("max", 8).arg("n", 7);
+    for (const auto& zone : stats) {
+        lines << QString("%1 %2 %3 %4 %5 %6")
+                     .arg(QString::fromStdString(zone.name), -30)
+                     .arg(zone.p50Ms, 8, 'f', 3)
+                     .arg(zone.p95Ms, 8, 'f', 3)
+                     .arg(zone.p99Ms, 8, 'f', 3)
+                     .arg(zone.maxMs, 8, 'f', 3)
+                     .arg(static_cast<qulonglong>(zone.count), 7);
+    }
+
+    int textWidth = 0;
+    for (const QString& line : lines) {
+        textWidth = std::max(textWidth, metrics.horizontalAdvance(line));
+    }
+    const int lineHeight = metrics.height();
+    QRectF textRect(width() - textWidth - 15, 10, textWidth, lineHeight * lines.size());
+
+    painter.setBrush(QColor(0, 0, 0, 180));
+    painter.setPen(Qt::NoPen);
+    painter.drawRect(textRect.adjusted(-5, -5, 5, 5));
+
+    painter.setPen(Qt::green);
+    for (int i = 0; i < lines.size(); ++i) {
+        painter.drawText(QPointF(textRect.left(), textRect.top() + lineHeight * (i + 1) - metrics.descent()), lines[i]);
+    }
 }
 
 void SolarSystemWidget::wheelEvent(QWheelEvent *event)
@@ -200,6 +282,22 @@ void SolarSystemWidget::mouseMoveEvent(QMouseEvent *event)
     }
 }
 
+void SolarSystemWidget::keyPressEvent(QKeyEvent *event)
+{
+    if (event->key() == Qt::Key_P) {
+        m_showProfilerOverlay = !m_showProfilerOverlay;
+        update();
+    } else if (event->key() == Qt::Key_T) {
+        const QString path = "ss_sim_trace.json";
+        if (Profiler::writeChromeTrace(path.toStdString())) {
+            qDebug() << "Wrote profiler trace to" << path;
+        } else {
+            qWarning() << "Could not write profiler trace to" << path;
+        }
+    } else {
+        QWidget::keyPressEvent(event);
+    }
+}
 
 void SolarSystemWidget::updateView()
 {
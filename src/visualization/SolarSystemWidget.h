@@ -2,8 +2,11 @@
 #define SOLARSYSTEMWIDGET_H
 
 #include <QWidget>
+#include <cstdint>
 #include "../physics/NBodySimulation.h"
 
+class QPainter;
+
 class SolarSystemWidget : public QWidget
 {
     Q_OBJECT
@@ -19,11 +22,16 @@ protected:
     void wheelEvent(QWheelEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
+
+    // P toggles the profiler overlay, T dumps a Chrome trace
+    void keyPressEvent(QKeyEvent *event) override;
     
 private slots:
     void updateView();
 
 private:
+    void drawProfilerOverlay(QPainter& painter);
+
     NBodySimulation* m_simulation;
 
     // View control variables
@@ -33,6 +41,10 @@ private:
 
     //Variable to track the selected body by its index in the vector
     int m_selectedBodyIndex;
+
+    // Profiler overlay state
+    bool m_showProfilerOverlay;
+    std::int64_t m_lastFrameStartNs; // Start of the previous paint, for frame-to-frame time
 };
 
 #endif // SOLARSYSTEMWIDGET_H